@@ -98,6 +98,18 @@ void LCD_PrepareBuffers(void) {
     }
 }
 
+// Set the addresses in a buffer so its line i is written to the LCD line
+// first+i+1, wrapping around: scrolls the whole display without moving data
+void LCD_LineAddresses(uint8_t *setup, uint8_t first) {
+    uint8_t *p = setup+1;                       // Address of the first line
+    for(uint8_t i=0; i<128; i++) {
+        uint8_t r=((first+i)&127)+1;
+        REVERSE(r);                             // The address needs to be bit reversed
+        *p=r;
+        p+=DISPLAY_BYTES_IN_ROW;                // Address of the next line, in the trailer
+    }
+}
+
 // Transfer display buffer to LCD
 // 2306 bytes to be sent:
 //     Mode
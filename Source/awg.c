@@ -2,10 +2,193 @@
 #include <util/delay.h>
 #include <avr/interrupt.h>
 #include "awg.h"
+#include "usb\usb_xmega.h"
+
+// DDS engine: the DAC runs at a fixed 62.5kHz and the DMA plays blocks of
+// DDS_BLOCK samples, alternating between two halves of DDSBuffer. When a block
+// ends, the high level DMA interrupt starts the other half, so the restart is
+// not held by the medium level interrupts or by Apply(), which masks them. The
+// refill of the block just played is left to the TCD1 CCB interrupt, at medium
+// level, one sample later. The DMA controller can't do this alone: its double
+// buffer mode pairs CH3 with CH2, which sends the display and captures the
+// logic channel, and the only interrupt is at the end of a transaction, where
+// a repeated transaction reloads the same start address.
+// Each sample is read from one cycle of the wave in AWGBuffer, at the top 8
+// bits of a 32 bit phase accumulator. The increment is F*2^32/fs, the
+// frequency error is below fs/2^32 = 15uHz at any frequency and a new
+// frequency continues the phase.
+
+// BuildWave runs in stages, each one only when its parameters changed:
+// shape (wave type and duty cycle) into AWGShape, then gain and offset into
+// the back buffer, then the timer period. A frequency sweep usually only
+// changes the period, an amplitude or offset sweep skips the shape.
+
+// Double buffer: BuildWave writes the buffer that is not playing, then clears
+// the DMA repeat bit so the current pass is the last one. The transaction
+// interrupt starts the new buffer and loads its timer period, so a new wave
+// always starts at the beginning of a cycle, at a whole number of cycles of
+// the old one.
+
+// Modulation, with the DDS engine only: every MOD_STEP samples the refill
+// takes the next value of the modulating wave, from its own phase accumulator,
+// and applies it to the next samples:
+//   AM:  the gain, the buffer holds the shape without gain and offset, and the
+//        refill scales it with the gain and offset BuildWave left in AMAmp and
+//        AMOffset. Shape() can rewrite AWGShape while the blocks play.
+//   FM:  the phase increment, the deviation is ModDepth % of the frequency
+//   PWM: the duty of a two level wave, ModDepth % of a cycle around AWGduty
+
+// Streaming: the host sends samples on the EP1 OUT endpoint, one packet per
+// slot of a ring in AWGWave, and the DMA plays the slots in order at a fixed
+// rate. When the ring is full the endpoint is not armed again, the host gets
+// NAKs until a slot is played. When the DMA finds the next slot empty the DAC
+// keeps the last sample, the underrun is counted and the playback waits until
+// STREAM_START slots are ready again.
+
+// Burst: the DMA plays one cycle per block, from the start of the buffer, and
+// the repeat count gives the number of cycles. A last one byte transaction
+// then leaves the DAC at the offset. A triggered burst is armed after that:
+//   CH1, CH2: the scope trigger restarts TCD1 and starts the DMA, asmutil.S post
+//   Logic bit, EXT: the edge on Event CH2 is captured by TCD1 CCA, and its
+//   interrupt moves the timer to where it would be had it restarted at the
+//   edge, whatever the interrupt latency, then starts the DMA
+// Either way the first sample is converted (PER+1)*prescaler cycles after the
+// timer restart, plus the DAC settling time.
+
+// Continuous noise, with the DDS engine: the blocks are filled with new
+// samples of a 32 bit xorshift generator instead of reading the wave, so the
+// noise doesn't repeat every 256 samples.
+//   Pink: Voss-McCartney, row r of NOISE_ROWS is drawn again every 2^(r+1)
+//         samples, the output is the sum of the rows plus a white sample
+//   Band: two one pole low pass filters, with the cutoff of the pair at the
+//         AWG frequency, the coefficient from BandRatio. The state keeps
+//         16 fraction bits so low cutoffs don't drift, and a gain of 2^n
+//         keeps the level within about 6dB.
+
+// Harmonic synthesis: the shape is the sum of HARMONICS sines, each sample
+// adds HarmAmp[h]*Sin((h+1)*i+phase) for each harmonic that is on, with the
+// phase in Sin() steps, 256 per cycle; phase 0 is a sine starting at 0. The
+// sums are then scaled so the highest peak is 127, whatever the amplitudes
+// add to. Like any other shape, it is only built again when the wave type,
+// the duty cycle, or a harmonic changes.
+
+// Timed sweep: the log and list frequency sweeps step on the TCD0L underflow,
+// every 40.96ms, whatever the screen is doing. A step only changes the timer
+// period or the DDS increment, the cycles in the buffer are chosen once for
+// the highest frequency of the sweep.
+//   Log:  M.Sweep1 and M.Sweep2 are in SWEEP_SCALE/256 of an octave from 1Hz,
+//         each step moves M.SWSpeed/256 of an octave. The octave is the top
+//         bits of the position, the fraction comes from a 2^(k/16) table with
+//         linear interpolation, within 0.1% above 10Hz.
+//   List: each frequency of SweepList plays for M.SWSpeed steps
+// The marker on the EXT TRIG pin is high during the first step of each list
+// frequency and of each log sweep, so the EXT trigger source can capture at a
+// known point of the sweep.
 
 // Global AWG variables
-uint8_t AWGBuffer[BUFFER_AWG]; // AWG Output Buffer
+static uint8_t AWGWave[2][BUFFER_AWG];      // AWG Output Buffers
+uint8_t * volatile AWGBuffer = AWGWave[0];  // Buffer playing
 uint8_t cycles;         // Cycles in AWG buffer
+uint8_t AWGCtrl;        // AWG engine options
+static volatile uint8_t AWGPending;         // The back buffer plays when the current pass ends
+static uint16_t AWGPer;                     // Timer period of the newest wave
+static uint8_t AWGPrescaler;                // Timer prescaler of the newest wave
+static int8_t  AWGShape[BUFFER_AWG];        // Wave with the duty cycle, before gain and offset
+static uint8_t KeyType=0xFF, KeyDuty;       // Parameters of AWGShape
+static int8_t  KeyAmp, KeyOffset;           // Parameters of the newest wave
+static uint8_t KeyCycles, KeyAM;
+static uint8_t DDSBuffer[2][DDS_BLOCK];     // Blocks played by the DMA
+static uint8_t DDSHalf;                     // Block being played
+static uint8_t DDSOn;                       // The DMA is set for the DDS engine
+static uint32_t DDSPhase;                   // Phase of the next sample to compute
+static volatile uint32_t DDSInc;            // Phase increment per sample
+static volatile uint8_t StreamLen[STREAM_SLOTS];    // Bytes in each slot, 0 if free
+static uint8_t StreamRd;                    // Slot playing
+static uint8_t StreamWr;                    // Slot being received
+static uint8_t StreamFull;                  // The endpoint waits for a free slot
+static uint8_t StreamPlaying;               // The DMA is playing the ring
+uint16_t StreamUnderruns;                   // Times the DMA found the ring empty
+uint8_t ModCtrl;                            // Modulation type and modulating wave
+uint8_t ModOff;                             // Modulation set, but off above DDS_MAXF
+uint8_t ModRate=6;                          // Modulation rate, 10Hz
+uint8_t ModDepth=50;                        // Modulation depth, %
+static uint32_t ModPhase;                   // Phase of the modulating wave
+static uint32_t ModInc;                     // Modulating phase increment per update
+static uint32_t FMDev;                      // FM: increment deviation at full modulation
+static uint8_t  AMDepth;                    // AM: depth, 128 = 100%
+static int8_t   AMAmp, AMOffset;            // AM: gain and offset of the newest wave
+static uint8_t  DDSMod;                     // Modulation of the wave in AWGBuffer
+static uint16_t PWMDuty, PWMDev;            // PWM: duty and swing, 65536 = 1 cycle
+static uint8_t  PWMHigh, PWMLow;            // PWM: output levels
+uint8_t AWGBurst=10;                        // Cycles per burst
+volatile uint8_t AWGTrigger;                // DMA CH3 CTRLA for asmutil.S post, 0 if not armed
+static uint8_t BurstOn;                     // The DMA is set for bursts
+static uint8_t BurstWave;                   // The burst is playing or armed, otherwise the idle level
+static uint8_t AWGIdle;                     // DAC level between bursts
+uint8_t NoiseCtrl;                          // Noise generator
+static uint8_t  NoiseType;                  // Generator playing, NOISE_TABLE if off
+static uint32_t NoiseSeed=1;                // xorshift state
+static int8_t   PinkRows[NOISE_ROWS];       // Pink: the value of each row
+static int16_t  PinkSum;                    // Pink: the sum of the rows
+static uint16_t PinkCount;                  // Pink: samples, the trailing zeros select the row
+static int32_t  BandY1, BandY2;             // Band: filter states, 16 fraction bits
+static uint16_t BandAlpha;                  // Band: filter coefficient, 65536 = 1
+static uint8_t  BandShift;                  // Band: level correction
+static int8_t   NoiseAmp, NoiseOffset;      // Gain and offset of the samples
+uint8_t  HarmAmp[HARMONICS] = { 100 };     // Amplitude of each harmonic, %: the fundamental only
+uint16_t HarmPhase[HARMONICS];              // Phase of each harmonic, degrees
+uint8_t SweepCtrl;                          // Frequency sweep type and marker
+uint8_t SweepLen=31;                        // Frequencies in SweepList
+static uint32_t SweepList[SWEEP_LIST_MAX] = {   // ISO third octave bands, Hz*100
+    2000, 2500, 3150, 4000, 5000, 6300, 8000, 10000, 12500, 16000, 20000,
+    25000, 31500, 40000, 50000, 63000, 80000, 100000, 125000, 160000,
+    200000, 250000, 315000, 400000, 500000, 630000, 800000, 1000000,
+    1250000, 1600000, 2000000
+};
+static uint8_t  SweepOn;                    // The TCD0L tick steps the frequency
+static uint8_t  SweepType;                  // Sweep type when the tick started
+static uint8_t  SweepDown;                  // Stepping down
+static uint8_t  SweepDwell;                 // Steps at the current list frequency
+static volatile uint32_t SweepFreq;         // Frequency set by the tick, copied to M.AWGdesiredF
+static uint16_t SweepPos;                   // Log position or list index
+
+// 2^(k/16), k = 0 to 16, *16384
+static const uint16_t Exp2[17] PROGMEM = {
+    16384, 17109, 17867, 18658, 19484, 20347, 21247, 22188, 23170,
+    24196, 25268, 26386, 27554, 28774, 30048, 31379, 32768
+};
+
+// Band noise: the exact coefficient of each pole, for the pair to be -3dB at F,
+// over the first order 2*pi*F*1.55/fs, *4096, every fs/32 from 0 to fs/2
+static const uint16_t BandRatio[17] PROGMEM = {
+    4091, 3509, 3015, 2604, 2268, 1992, 1766, 1580, 1425,
+    1295, 1184, 1089, 1007,  935,  872,  816,  766
+};
+
+// Modulation rates, Hz*100
+static const uint32_t ModRates[MOD_RATES] PROGMEM = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+static uint32_t DDSIncrement(uint32_t f);
+static void DDSFill(uint8_t *p);
+static void NoiseFill(uint8_t *p);
+static uint32_t BandCoef(uint32_t f);
+static void DDSStart(void);
+static void AWGPlay(void);
+static void StreamPlay(void);
+static void StreamArm(void);
+static void Shape(void);
+static void Harmonics(int8_t *p);
+static int8_t ModValue(void);
+static void BurstStart(void);
+static void BurstLoad(void);
+static void BurstHold(void);
+static void TrigArm(void);
+static void TrigOff(void);
+static uint16_t Period(uint32_t f, uint8_t *prescaler);
+static uint32_t SweepTop(void);
+static void SweepSet(uint32_t f);
 
 void moveF(void) {
     uint8_t i=6;        // Start checking at 10KHz
@@ -31,8 +214,17 @@ void moveF(void) {
 // Low periods have poor Freq resolution
 // High cycles have poor Amp resolution
 void BuildWave(void) {
+    if(testbit(AWGCtrl,awgstream)) {        // The host owns the DAC
+        clrbit(MStatus, updateawg);
+        return;
+    }
     if(M.AWGamp>0)      M.AWGamp=0;         // AWGAmp must be negative
     if(M.AWGduty==0)    M.AWGduty=1;        // Zero is invalid
+    if(SweepOn) {                           // The tick may have stepped
+        cli();
+        M.AWGdesiredF = SweepFreq;
+        sei();
+    }
     uint8_t *pf = (uint8_t *)&M.AWGdesiredF;           // Get address of M.AWGdesiredF
     if(M.AWGdesiredF==0)  *pf = 1;          // Minimum Freq= 0.01Hz (only need to access lower byte of M.AWGdesiredF)
     // Maximum Frequency check done at CheckMax function
@@ -44,13 +236,132 @@ void BuildWave(void) {
     //  F >  1966Hz -> cycles =  4, prescale = 1   (Period range:   254 - 127)
     //  F >   983Hz -> cycles =  2, prescale = 1   (Period range:   254 - 127)
     //  F >  2.56Hz -> cycles =  1, prescale = 1   (Period range: 48828 - 127)
-    uint8_t Fcomp8 = M.AWGdesiredF >> 16;   // Use only 8bits for comparison
+    // A timed sweep keeps the cycles of its highest frequency
+    uint32_t top = SweepOn ? SweepTop() : M.AWGdesiredF;
+    uint8_t Fcomp8 = top >> 16;             // Use only 8bits for comparison
     uint8_t Flevel= 1572864>>16;           // Choose 15728Hz as transition frequency (Flevel = 18h)
     for (cycles = 32; cycles > 1 && Fcomp8 < Flevel; cycles >>= 1) {
         Flevel >>= 1;
     }
+    uint8_t burst = testbit(AWGCtrl,awgburst);
+    uint8_t noise = (M.AWGtype==0) ? NoiseCtrl : NOISE_TABLE;
+    uint8_t dds = !burst && (noise || ((testbit(AWGCtrl,awgdds) || (ModCtrl&modtype)) && top<=DDS_MAXF));
+    if(dds) cycles=1;                       // One cycle, the DDS reads it at any rate
+    uint8_t mod = dds? ModCtrl&modtype: MOD_OFF;
+    ModOff = (ModCtrl&modtype) && !burst && top>DDS_MAXF;  // Shown in the modulation menus
+    uint8_t am = mod==MOD_AM;               // The buffer keeps the shape, the refill scales it
+    uint8_t i=0;
+    if(M.AWGtype!=KeyType || M.AWGduty!=KeyDuty) {
+        PROFILE_ON(PROFILE_SHAPE);
+        Shape();
+        PROFILE_OFF(PROFILE_SHAPE);
+        KeyType=M.AWGtype;
+        KeyDuty=M.AWGduty;
+        KeyCycles=0;                        // Scale again
+    }
+    uint8_t scale = M.AWGamp!=KeyAmp || M.AWGoffset!=KeyOffset || cycles!=KeyCycles || am!=KeyAM;
+    uint8_t *back=0;
+    PMIC.CTRL = 0x06;   // Disable low level interrupts
+    if(scale) {
+        cli();
+        AWGPending = 0;                     // The back buffer is written again
+        back = AWGWave[AWGBuffer==AWGWave[0]];
+        sei();
+        PROFILE_ON(PROFILE_SCALE);
+        if(am) do { back[i]=AWGShape[i]; } while(++i);
+        else do {
+        // ******** Multiply by Gain ********
+            uint8_t j=FMULS8(M.AWGamp,AWGShape[(uint8_t)(i*cycles)]); // Keep index < 256
+        // ******** Add Offset ********
+            back[i]=saddwsat(j,M.AWGoffset);
+        } while(++i);
+        KeyAmp=M.AWGamp;
+        KeyOffset=M.AWGoffset;
+        KeyCycles=cycles;
+        KeyAM=am;
+        PROFILE_OFF(PROFILE_SCALE);
+    }
+    PROFILE_ON(PROFILE_TIMING);
+    if(dds) {
+        uint32_t ddsinc = DDSIncrement(M.AWGdesiredF);
+        uint32_t modinc = DDSIncrement(ModFrequency())*MOD_STEP;
+        uint32_t fmdev = DDSIncrement(M.AWGdesiredF/100*ModDepth)>>7;
+        int32_t duty = (uint16_t)M.AWGduty<<8;
+        uint32_t alpha = BandCoef(M.AWGdesiredF);
+        uint8_t shift = 0;
+        if(alpha>65535) alpha = 65535;
+        if(alpha<16) alpha = 16;
+        for(uint16_t a=alpha; a>1; a>>=1) shift++;
+        shift = (16-shift)/2;               // Gain about the square root of 1/alpha
+        cli();
+        NoiseType = noise;
+        NoiseAmp = M.AWGamp;
+        NoiseOffset = M.AWGoffset;
+        BandAlpha = alpha;
+        BandShift = shift;
+        ModInc = modinc;
+        FMDev = fmdev;
+        AMDepth = ((uint16_t)ModDepth*41)>>5;   // *128/100
+        AMAmp = M.AWGamp;
+        AMOffset = M.AWGoffset;
+        PWMDuty = duty;
+        PWMDev = (uint16_t)ModDepth*655/127;    // ModDepth % of a cycle at full modulation
+        PWMHigh = saddwsat(FMULS8(M.AWGamp,-127),M.AWGoffset);
+        PWMLow  = saddwsat(FMULS8(M.AWGamp,127),M.AWGoffset);
+        if(scale || AWGPending) {           // Read the newest wave from the next block on
+            AWGBuffer = AWGWave[AWGBuffer==AWGWave[0]];
+            AWGPending = 0;
+        }
+        DDSMod = mod;                       // Together with the buffer it applies to
+        DDSInc = ddsinc;                    // The phase continues
+        sei();
+        if(!DDSOn) {
+            if(BurstOn) AWGDMAInit();
+            TCD1.CTRLA = 0x01;              // Prescaler: 1
+            TCD1.PERBUF = DDS_PER;
+            DDSStart();
+        }
+    }
+    else {
+        uint8_t prescaler;
+        uint16_t per = Period(M.AWGdesiredF, &prescaler);
+        if(DDSOn || (BurstOn && !burst)) AWGDMAInit();
+        cli();
+        AWGPer = per;
+        AWGPrescaler = prescaler;
+        if(scale) AWGPending = 1;
+        // New burst, the one playing is cut short
+        if(burst) {
+            AWGIdle = saddwsat(0,M.AWGoffset);
+            BurstStart();
+        }
+        // Start now if nothing is playing
+        else if(!testbit(DMA.CH3.CTRLA,7) || TCD1.CTRLA==0) {
+            TCD1.CTRLA = prescaler;
+            TCD1.PERBUF = per;
+            AWGPlay();
+        }
+        // New wave: switch when the buffer ends
+        else if(scale) {
+            DMA.CH3.CTRLB = 0x13;           // Clear the transaction flag, high level interrupt
+            DMA.CH3.CTRLA = 0b10000100;     // No repeat: this transaction is the last
+        }
+        // Same wave: avoid discontinuity when changing frequency by writing to PERBUF
+        else if(!AWGPending) {
+            TCD1.CTRLA = prescaler;
+            TCD1.PERBUF = per;
+        }
+        sei();
+    }
+    PROFILE_OFF(PROFILE_TIMING);
+    clrbit(MStatus, updateawg);
+    clrbit(Misc,bigfont);    // default value
+    PMIC.CTRL = 0x07; // Enable all interrupts
+}
+
+// Shape of the wave, with the duty cycle applied
+static void Shape(void) {
     // Construct 256 bytes waveform
-    
     int8_t *p=(int8_t *)T.AWGDATA.AWGTemp1;
     uint16_t Seed;
     uint8_t i=0;
@@ -80,10 +391,13 @@ void BuildWave(void) {
         case 5: // Custom wave from EEPROM
             eeprom_read_block(T.AWGDATA.AWGTemp1, EEwave, BUFFER_AWG);
         break;
+        case AWG_HARMONIC:
+            Harmonics(p);
+        break;
     }
     // Prepare output buffer:
     // ******** Duty cycle ********
-    // Time-warp the 256-sample source (AWGTemp1) into the output (AWGTemp2) with a
+    // Time-warp the 256-sample source (AWGTemp1) into the output (AWGShape) with a
     // phase accumulator: 'step' advances by one increment over the source's first
     // half and another over the second, so each half occupies an output span set by
     // AWGduty (this shifts the waveform's midpoint = duty cycle). hibyte(step) is the
@@ -95,39 +409,619 @@ void BuildWave(void) {
     p=(int8_t *)T.AWGDATA.AWGTemp1;
     do {
         uint8_t j=hibyte(step);
-        T.AWGDATA.AWGTemp2[j] = *p;
+        AWGShape[j] = *p;
         int8_t awgpoint;
         if(!testbit(Misc,bigfont)) {  // Interpolation
             int8_t k=*p++;
             awgpoint = (k+(*p))/2;
         } else awgpoint = *p++;         // No Interpolation
-        if(j<255) T.AWGDATA.AWGTemp2[j+1] = awgpoint;
+        if(j<255) AWGShape[j+1] = awgpoint;
         step+=inc;
         if(i==127) inc=M.AWGduty<<1;
     } while(++i);
-    // 
-    uint32_t Numerator, Denominator;
-    Numerator = 12500000 * cycles;
-    uint16_t Fcomp16 = M.AWGdesiredF >> 8;   // Use only 16bits for comparison
-    PMIC.CTRL = 0x06;   // Disable low level interrupts
-    if(Fcomp16<(256>>8)) {          // F < 2.56Hz
-        TCD1.CTRLA = 0x06;                  // Prescaler: 256
-        Denominator = M.AWGdesiredF * 256;
+}
+
+// Sum of the harmonics, scaled to a peak of 127
+// The sums take the first 512 bytes of TempCH1, each scaled sample is written
+// over sums already read
+static void Harmonics(int8_t *p) {
+    int16_t *sum=T.AWGDATA.HarmSum;
+    uint16_t peak=1;
+    uint8_t phase[HARMONICS], i=0, h;
+    for(h=0; h<HARMONICS; h++) phase[h]=((uint32_t)HarmPhase[h]*256+180)/360;
+    do {
+        int32_t s=0;
+        for(h=0; h<HARMONICS; h++) {
+            if(HarmAmp[h]==0) continue;
+            s+=(int16_t)HarmAmp[h]*Sin((h+1)*i+phase[h]);
+        }
+        s>>=3;                              // 16*100*127/8 fits in 16 bits
+        sum[i]=s;
+        if(s<0) s=-s;
+        if(s>peak) peak=s;
+    } while(++i);
+    do {
+        *p++=((int32_t)sum[i]*127)/peak;
+    } while(++i);
+}
+
+// Build the whole wave on the next BuildWave
+void AWGFlush(void) {
+    KeyType=0xFF;
+}
+
+// DMA for DAC, stopped until the first wave is built
+void AWGDMAInit(void) {
+    DMA.CH3.CTRLA     = 0;          // Disable CH3
+    DMA.CH3.CTRLB     = 0x10;       // Clear the transaction flag, no interrupts
+    DDSOn = 0;
+    AWGPending = 0;
+    StreamPlaying = 0;
+    BurstOn = 0;
+    TrigOff();
+    DMA.CH3.ADDRCTRL  = 0xD0;   // Reload after transaction, Increment source
+    DMA.CH3.TRIGSRC   = 0x26;   // Trigger source is DACB CH1
+	DMA.CH3.DESTADDR0 = (((uint16_t)(&DACB.CH1DATAH))>>0*8) & 0xFF;
+	DMA.CH3.DESTADDR1 = (((uint16_t)(&DACB.CH1DATAH))>>1*8) & 0xFF;
+//	DMA.CH3.DESTADDR2 = 0;
+}
+
+// Actual AWG frequency, Hz*100
+uint32_t AWGFrequency(void) {
+    uint32_t Denominator = AWGPer+1;
+    if(DDSOn) return M.AWGdesiredF;     // Within 15uHz
+    if(AWGPrescaler != 0x01) Denominator*=256;
+    return cycles*12500000/Denominator;
+}
+
+// Restart the DMA on the buffer playing, or on the back buffer if it is ready
+static void AWGPlay(void) {
+    DMA.CH3.CTRLA = 0;                  // Disable CH3
+    if(AWGPending) {
+        AWGBuffer = AWGWave[AWGBuffer==AWGWave[0]];
+        AWGPending = 0;
+        TCD1.CTRLA = AWGPrescaler;
+        TCD1.PERBUF = AWGPer;
+    }
+    DMA.CH3.ADDRCTRL  = 0xD0;           // Reload after transaction, Increment source
+    DMA.CH3.TRFCNT    = BUFFER_AWG;   // AWG Buffer size
+    DMA.CH3.REPCNT    = 0;              // Repeat until stopped
+	DMA.CH3.SRCADDR0  = (((uint16_t) AWGBuffer)>>0*8) & 0xFF;
+	DMA.CH3.SRCADDR1  = (((uint16_t) AWGBuffer)>>1*8) & 0xFF;
+//	DMA.CH3.SRCADDR2  = 0;
+    DMA.CH3.CTRLB     = 0x10;           // Clear the transaction flag, no interrupts
+    DMA.CH3.CTRLA     = 0b10100100;     // Enable CH3, repeat mode, 1 byte burst, single
+}
+
+// Switch the DMA to the DDS blocks
+static void DDSStart(void) {
+    DMA.CH3.CTRLA = 0;                  // Disable CH3
+    DDSPhase = 0;
+    DDSHalf = 0;
+    DDSFill(DDSBuffer[0]);
+    DDSFill(DDSBuffer[1]);
+    DMA.CH3.TRFCNT    = DDS_BLOCK;
+    TCD1.CCB          = 0;              // The refill interrupt comes at the next overflow
+	DMA.CH3.SRCADDR0  = (((uint16_t) DDSBuffer[0])>>0*8) & 0xFF;
+	DMA.CH3.SRCADDR1  = (((uint16_t) DDSBuffer[0])>>1*8) & 0xFF;
+    DMA.CH3.CTRLB     = 0x13;           // Clear the transaction flag, high level interrupt
+    DMA.CH3.CTRLA     = 0b10000100;     // Enable CH3, 1 byte burst, single
+    DDSOn = 1;
+}
+
+// Play or arm a burst of the newest wave, stopping the DMA first
+static void BurstStart(void) {
+    DMA.CH3.CTRLA = 0;                  // Disable CH3
+    TrigOff();
+    if(AWGPending) {
+        AWGBuffer = AWGWave[AWGBuffer==AWGWave[0]];
+        AWGPending = 0;
+    }
+    TCD1.CTRLA = AWGPrescaler;
+    TCD1.PERBUF = AWGPer;
+    BurstOn = 1;
+    if(testbit(AWGCtrl,awgtrig)) {      // Idle level first, then armed by the interrupt
+        BurstWave = 0;
+        BurstHold();
     }
     else {
+        BurstLoad();
+        BurstWave = 1;
+        DMA.CH3.CTRLA = 0b10100100;     // Enable CH3, repeat mode, 1 byte burst, single
+    }
+}
+
+// Set the DMA for AWGBurst cycles, without enabling it
+static void BurstLoad(void) {
+    DMA.CH3.ADDRCTRL  = 0x50;           // Reload after block, Increment source
+    DMA.CH3.TRFCNT    = BUFFER_AWG/cycles;  // One cycle
+    DMA.CH3.REPCNT    = AWGBurst;
+	DMA.CH3.SRCADDR0  = (((uint16_t) AWGBuffer)>>0*8) & 0xFF;
+	DMA.CH3.SRCADDR1  = (((uint16_t) AWGBuffer)>>1*8) & 0xFF;
+    DMA.CH3.CTRLB     = 0x13;           // Clear the transaction flag, high level interrupt
+}
+
+// Send the idle level to the DAC, after the sample being converted
+static void BurstHold(void) {
+    DMA.CH3.TRFCNT    = 1;
+	DMA.CH3.SRCADDR0  = (((uint16_t) &AWGIdle)>>0*8) & 0xFF;
+	DMA.CH3.SRCADDR1  = (((uint16_t) &AWGIdle)>>1*8) & 0xFF;
+    DMA.CH3.CTRLB     = 0x13;           // Clear the transaction flag, high level interrupt
+    DMA.CH3.CTRLA     = 0b10000100;     // Enable CH3, 1 byte burst, single
+}
+
+static uint8_t TrigMux;             // EVSYS.CH2MUX before TrigArm took Event CH2
+static uint8_t TrigMuxed;           // Event CH2 taken, TrigOff gives it back
+
+// Wait for the trigger, the DMA is loaded
+static void TrigArm(void) {
+    if(M.Tsource<2) AWGTrigger = 0b10100100;    // CH1 or CH2: the scope trigger starts it
+    else {                                      // Logic bit or EXT: rising edge on Event CH2
+        if(!TrigMuxed) {                // Event CH2 is also the frequency counter source
+            TrigMux = EVSYS.CH2MUX;
+            TrigMuxed = 1;
+        }
+        if(M.Tsource==10) EVSYS.CH2MUX = EXT_TRIGGER;
+        else EVSYS.CH2MUX = 0x60-2+M.Tsource;   // PORTC Pin M.Tsource-2
+        TCD1.CTRLB = 0x10;              // CCA enabled, normal mode
+        TCD1.CTRLD = 0x2A;              // Input capture on Event CH2
+        TCD1.INTFLAGS = 0x10;           // Clear the CCA flag
+        TCD1.INTCTRLB = 0x03;           // CCA high level interrupt
+    }
+}
+
+static void TrigOff(void) {
+    AWGTrigger = 0;
+    TCD1.INTCTRLB = 0;
+    TCD1.CTRLD = 0;
+    TCD1.CTRLB = 0;
+    if(TrigMuxed) {
+        EVSYS.CH2MUX = TrigMux;
+        TrigMuxed = 0;
+    }
+}
+
+// Timer period for F, Hz*100, with the current cycles. Below 2.56Hz, or when
+// the cycles of a sweep are too many for F, the prescaler is 256.
+static uint16_t Period(uint32_t f, uint8_t *prescaler) {
+    uint32_t n = 12500000 * cycles / f;
+    *prescaler = 0x01;                  // Prescaler: 1
+    if(f<256 || n>65536) {
+        *prescaler = 0x06;              // Prescaler: 256
+        n >>= 8;
+    }
+    // The trigger interrupt must start the DMA within one sample
+    if(testbit(AWGCtrl,awgburst) && testbit(AWGCtrl,awgtrig) && *prescaler==0x01 && n<=TRIG_MINPER) n = TRIG_MINPER+1;
+    return n-1;
+}
+
+// F*2^32/(fs*100), F in Hz*100, fs=62.5kHz: F*2^28/390625
+static uint32_t DDSIncrement(uint32_t f) {
+    uint32_t q=f/390625, r=f%390625;
+    for(uint8_t i=28; i; i--) {         // Long division, one bit at a time
+        q<<=1; r<<=1;
+        if(r>=390625) { r-=390625; q++; }
+    }
+    return q;
+}
+
+static void DDSFill(uint8_t *p) {
+    if(NoiseType) {
+        NoiseFill(p);
+        return;
+    }
+    uint32_t phase=DDSPhase, inc=DDSInc;
+    const uint8_t *wave=AWGBuffer;
+    uint8_t mod=DDSMod, i, j;
+    if(mod==MOD_OFF) {
+        for(i=DDS_BLOCK; i; i--) {
+            *p++ = wave[(uint8_t)(phase>>24)];
+            phase+=inc;
+        }
+    }
+    else for(j=DDS_BLOCK/MOD_STEP; j; j--) {
+        int8_t m=ModValue();
+        if(mod==MOD_AM) {           // Gain from 100% down to 100%-depth
+            int8_t amp=((int16_t)AMAmp*(128-((AMDepth*(uint8_t)(127-m))>>8)))>>7;
+            int8_t offset=AMOffset;
+            for(i=MOD_STEP; i; i--) {
+                *p++ = saddwsat(FMULS8(amp,(int8_t)wave[(uint8_t)(phase>>24)]),offset);
+                phase+=inc;
+            }
+        }
+        else if(mod==MOD_FM) {
+            uint32_t f=inc+(int32_t)FMDev*m;
+            for(i=MOD_STEP; i; i--) {
+                *p++ = wave[(uint8_t)(phase>>24)];
+                phase+=f;
+            }
+        }
+        else {                      // PWM
+            int32_t d=PWMDuty+(int32_t)PWMDev*m;
+            if(d<0) d=0;
+            if(d>65535) d=65535;
+            for(i=MOD_STEP; i; i--) {
+                *p++ = ((uint16_t)(phase>>16)<(uint16_t)d)? PWMHigh: PWMLow;
+                phase+=inc;
+            }
+        }
+    }
+    DDSPhase=phase;
+}
+
+// Band noise pole coefficient for a cutoff of the pair at f, Hz*100, 65536 = 1
+static uint32_t BandCoef(uint32_t f) {
+    uint32_t r;
+    uint16_t a, b;
+    uint8_t k;
+    if(f>3125000) f = 3125000;          // Nyquist
+    k = f*16/3125000;
+    r = f*16%3125000;
+    a = pgm_read_word_near(BandRatio+k);
+    b = (k<16) ? pgm_read_word_near(BandRatio+k+1) : a;
+    a -= (uint32_t)(a-b)*r/3125000;     // Interpolated, within 0.1dB of -3dB
+    return ((f*41/400)*a)>>12;
+}
+
+// New noise samples, with the gain and offset applied
+static void NoiseFill(uint8_t *p) {
+    uint32_t x=NoiseSeed;
+    for(uint8_t i=DDS_BLOCK; i; i--) {
+        int8_t v;
+        x^=x<<13;
+        x^=x>>17;
+        x^=x<<5;
+        v=x>>24;
+        if(NoiseType==NOISE_PINK) {
+            uint16_t c=++PinkCount;
+            uint8_t r=0;
+            int16_t s;
+            while(!(c&1) && r<NOISE_ROWS-1) { c>>=1; r++; }
+            PinkSum+=v-PinkRows[r];
+            PinkRows[r]=v;
+            s=(PinkSum+(int8_t)(x>>16))>>3;
+            if(s>127) s=127;
+            if(s<-127) s=-127;
+            v=s;
+        }
+        else if(NoiseType==NOISE_BAND) {
+            int32_t s;
+            BandY1+=(int32_t)(int16_t)(v-(int16_t)(BandY1>>16))*BandAlpha;
+            BandY2+=(int32_t)(int16_t)((int16_t)(BandY1>>16)-(int16_t)(BandY2>>16))*BandAlpha;
+            s=BandY2>>(16-BandShift);
+            if(s>127) s=127;
+            if(s<-127) s=-127;
+            v=s;
+        }
+        *p++ = saddwsat(FMULS8(NoiseAmp,v),NoiseOffset);
+    }
+    NoiseSeed=x;
+}
+
+// Next value of the modulating wave, -127 to 127
+static int8_t ModValue(void) {
+    uint8_t x;
+    ModPhase+=ModInc;
+    x=ModPhase>>24;
+    if((ModCtrl&modwave)==MOD_SQUARE) return (x<128)? 127: -127;
+    if((ModCtrl&modwave)==MOD_TRIANGLE) {
+        if(x<128) return (int16_t)x*2-127;
+        return 383-(int16_t)x*2;
+    }
+    return Sin(x);
+}
+
+// Modulation rate, Hz*100
+uint32_t ModFrequency(void) {
+    return pgm_read_dword_near(ModRates+ModRate);
+}
+
+// End of a DMA transaction
+// DDS: play the other block, the CCB interrupt refills this one
+// Burst: the last cycle is in the DAC, send the idle level. After the idle
+// level, arm the next burst if it is triggered.
+// Buffer: the last pass of the old wave is done, play the new one. If
+// BuildWave took the new one back to rewrite it, repeat the old one.
+// Always a high level interrupt: it restarts the DAC, and Apply() masks the
+// other levels. Only the DDS refill, in TCD1_CCB_vect, is at medium level.
+ISR(DMA_CH3_vect) {
+    if(DDSOn) {
+        DDSHalf^=1;
+        DMA.CH3.SRCADDR0  = (((uint16_t) DDSBuffer[DDSHalf])>>0*8) & 0xFF;
+        DMA.CH3.SRCADDR1  = (((uint16_t) DDSBuffer[DDSHalf])>>1*8) & 0xFF;
+        DMA.CH3.CTRLB     = 0x13;           // Clear the transaction flag
+        DMA.CH3.CTRLA     = 0b10000100;     // Enable CH3, 1 byte burst, single
+        TCD1.INTFLAGS     = 0x20;           // Clear the CCB flag
+        TCD1.INTCTRLB     = 0x08;           // CCB medium level interrupt, on the next sample
+    }
+    else if(testbit(AWGCtrl,awgstream)) {
+        StreamLen[StreamRd] = 0;            // Slot played
+        if(StreamFull) StreamArm();         // The host can send it again
+        StreamRd = (StreamRd+1)&(STREAM_SLOTS-1);
+        if(StreamLen[StreamRd]) StreamPlay();
+        else {
+            StreamPlaying = 0;              // The DAC keeps the last sample
+            StreamUnderruns++;
+            DMA.CH3.CTRLB = 0x10;           // Clear the transaction flag, no interrupts
+        }
+    }
+    else if(BurstOn) {
+        if(BurstWave) {
+            BurstWave = 0;
+            BurstHold();
+        }
+        else if(testbit(AWGCtrl,awgtrig)) {
+            BurstLoad();
+            BurstWave = 1;
+            TrigArm();
+        }
+        else DMA.CH3.CTRLB = 0x10;      // Clear the transaction flag, no interrupts
+    }
+    // A repeated pass, the last one is still playing
+    else if(testbit(DMA.CH3.CTRLA,7)) DMA.CH3.CTRLB = AWGPending? 0x13: 0x10;
+    else AWGPlay();
+}
+
+// DDS: refill the block just played, once per block
+ISR(TCD1_CCB_vect) {
+    TCD1.INTCTRLB = 0;
+    PROFILE_ON(PROFILE_DDS);
+    DDSFill(DDSBuffer[DDSHalf^1]);
+    PROFILE_OFF(PROFILE_DDS);
+}
+
+// Trigger edge, captured in CCA. CNT is set to the time since the edge, the
+// overflow that converts the first sample comes PER+1 timer clocks after it.
+// The interrupt must start within one sample, TRIG_MINPER.
+ISR(TCD1_CCA_vect) {
+    uint16_t cca=TCD1.CCA, per=TCD1.PER, cnt;
+    uint8_t fix = (TCD1.CTRLA==0x01)? TRIG_FIX: 0;  // Only at 1 cycle per count
+    TCD1.INTCTRLB = 0;                  // Once per burst
+    if(TCD1.INTCTRLA) return;           // The timer is playing a sound
+    cnt = TCD1.CNT;
+    if(cnt<cca) cnt+=per+1;             // The timer overflowed after the edge
+    cnt = cnt-cca+fix;
+    if(cnt>per) cnt-=per+1;
+    TCD1.CNT = cnt;
+    DMA.CH3.CTRLA = 0b10100100;         // Enable CH3, repeat mode, 1 byte burst, single
+}
+
+// Start or stop the timed frequency sweep, called once per frame
+void SweepRun(uint8_t on) {
+    uint8_t type = SweepCtrl&swtype;
+    if(!(TCD0.INTCTRLA&TC2_LUNFINTLVL_gm)) SweepOn = 0;  // Disabled when the scope started
+    if(SweepOn && (!on || type!=SweepType)) {
+        TCD0.INTCTRLA &= ~TC2_LUNFINTLVL_gm;    // Disable the TCD0L underflow interrupt
+        SweepOn = 0;
+        setbit(MStatus, updateawg);         // Cycles for the current frequency
+    }
+    if(on && !SweepOn && (type==SWEEP_LOG || SweepLen)) {
+        uint32_t f;
+        SweepType = type;
+        SweepDown = testbit(Sweep,swdown);
+        SweepDwell = 0;
+        if(type==SWEEP_LIST) {
+            SweepPos = SweepDown ? SweepLen-1 : 0;
+            f = SweepList[SweepPos];
+        }
+        else {
+            SweepPos = (SweepDown ? M.Sweep2 : M.Sweep1)*SWEEP_SCALE;
+            f = SweepLogF(SweepPos);
+        }
+        M.AWGdesiredF = f;
+        SweepFreq = f;
+        SweepOn = 1;
+        setbit(MStatus, updateawg);         // Cycles for the whole sweep
+        PORTB.OUTSET = 0x04;                // Marker: first step
+        TCD0.INTCTRLA |= TC2_LUNFINTLVL_LO_gc;  // TCD0L underflow, low level interrupt
+    }
+    if(SweepOn) {                           // Frequency of the last step
+        cli();
+        M.AWGdesiredF = SweepFreq;
+        sei();
+    }
+    // The marker drives EXT TRIG, unless the pin is the trigger or the counter input
+    if(SweepOn && testbit(SweepCtrl,swmarker) && M.Tsource!=10 && (MFFT>=0x20 || M.Tsource>=2)) PORTB.DIRSET = 0x04;
+    else {                                  // EXT TRIG back to an input
+        PORTB.DIRCLR = 0x04;
+        PORTB.OUTCLR = 0x04;
+    }
+}
+
+// Next step of the timed sweep, TCD0L underflow
+void SweepTick(void) {
+    uint8_t marker=0;
+    if(SweepType==SWEEP_LIST) {
+        int8_t i;
+        if(SweepLen==0) return;
+        if(++SweepDwell<M.SWSpeed) {
+            PORTB.OUTCLR = 0x04;
+            return;
+        }
+        SweepDwell = 0;
+        i = SweepPos + (SweepDown ? -1 : 1);
+        if(i<0 || i>=SweepLen) {            // End of the list
+            if(testbit(Sweep,pingpong)) {
+                SweepDown = !SweepDown;
+                i = SweepPos + (SweepDown ? -1 : 1);
+                if(i<0) i = 0;
+                if(i>=SweepLen) i = SweepLen-1;
+            }
+            else i = SweepDown ? SweepLen-1 : 0;
+        }
+        SweepPos = i;
+        marker = 1;
+        SweepSet(SweepList[i]);
+    }
+    else {
+        int16_t lo = M.Sweep1*SWEEP_SCALE, hi = M.Sweep2*SWEEP_SCALE;
+        int16_t pos = SweepPos + (SweepDown ? -M.SWSpeed : M.SWSpeed);
+        if(hi<lo) hi = lo;
+        if(pos<lo || pos>hi) {              // End of the sweep
+            if(testbit(Sweep,pingpong)) SweepDown = !SweepDown;
+            pos = SweepDown ? hi : lo;
+            marker = 1;
+        }
+        SweepPos = pos;
+        SweepSet(SweepLogF(pos));
+    }
+    if(marker) PORTB.OUTSET = 0x04;
+    else PORTB.OUTCLR = 0x04;
+}
+
+// Log sweep frequency at 1/256 octave steps from 1Hz, Hz*100
+uint32_t SweepLogF(uint16_t p) {
+    uint8_t octave = p>>8, r = p, k = r>>4;
+    uint16_t a = pgm_read_word_near(Exp2+k), b = pgm_read_word_near(Exp2+k+1);
+    uint32_t f = (uint32_t)(a + (((b-a)*(r&15))>>4))*100;
+    if(octave>=14) f <<= octave-14;
+    else f = (f+(1UL<<(13-octave)))>>(14-octave);   // Rounded
+    if(f>12517375) f = 12517375;        // Maximum AWG frequency
+    return f;
+}
+
+// Position of the timed sweep on the display, 0 to 127
+uint8_t SweepPixel(void) {
+    if(SweepType==SWEEP_LIST) return SweepLen ? ((uint16_t)SweepPos*128)/SweepLen : 0;
+    return SweepPos/(2*SWEEP_SCALE);
+}
+
+// Add a frequency to the list, Hz*100, or clear the list if 0
+uint8_t SweepAdd(uint32_t f) {
+    if(f==0) SweepLen = 0;
+    else if(SweepLen<SWEEP_LIST_MAX) {
+        if(f>12517375) f = 12517375;    // Maximum AWG frequency
+        SweepList[SweepLen] = f;
+        SweepLen++;
+    }
+    return SweepLen;
+}
+
+// Highest frequency of the timed sweep
+static uint32_t SweepTop(void) {
+    uint32_t top=0;
+    if(SweepType==SWEEP_LIST) {
+        for(uint8_t i=0; i<SweepLen; i++) if(SweepList[i]>top) top = SweepList[i];
+    }
+    else top = SweepLogF((M.Sweep2>M.Sweep1 ? M.Sweep2 : M.Sweep1)*SWEEP_SCALE);
+    return top ? top : 1;
+}
+
+// New frequency of the timed sweep, only the timer period or the DDS increment change.
+// Called from the tick: M.AWGdesiredF is 32 bits, SweepRun and BuildWave copy it.
+static void SweepSet(uint32_t f) {
+    SweepFreq = f;
+    if(testbit(AWGCtrl,awgstream)) return;
+    if(DDSOn) {
+        uint32_t inc = DDSIncrement(f);
+        cli();
+        DDSInc = inc;                   // The phase continues
+        sei();
+    }
+    else {
+        uint8_t prescaler;
+        uint16_t per = Period(f, &prescaler);
+        cli();
+        AWGPer = per;
+        AWGPrescaler = prescaler;
+        if(!AWGPending) {               // Otherwise loaded when the new wave starts
+            TCD1.CTRLA = prescaler;
+            TCD1.PERBUF = per;
+        }
+        sei();
+    }
+}
+
+// Start streaming with a timer period, in 32MHz cycles, or stop if 0
+void AWGStream(uint16_t per) {
+    cli();
+    AWGDMAInit();
+    if(per) {
+        if(per<STREAM_MINPER) per=STREAM_MINPER;
+        setbit(AWGCtrl, awgstream);
+        for(uint8_t i=0; i<STREAM_SLOTS; i++) StreamLen[i]=0;
+        StreamRd = 0;
+        StreamWr = 0;
+        StreamUnderruns = 0;
         TCD1.CTRLA = 0x01;                  // Prescaler: 1
-        Denominator = M.AWGdesiredF;
-    }        
-    // Avoid discontinuity when changing frequency by writing to PERBUF
-    TCD1.PERBUF = (Numerator / Denominator) -1;  // Set Period
-    i=0;
-    do {
-    // ******** Multiply by Gain ********
-        uint8_t j=FMULS8(M.AWGamp,T.AWGDATA.AWGTemp2[(uint8_t)(i*cycles)]); // Keep index < 256
-    // ******** Add Offset ********
-        AWGBuffer[i]=saddwsat(j,M.AWGoffset);
-    } while(++i);
-    clrbit(MStatus, updateawg);
-    clrbit(Misc,bigfont);    // default value
-    PMIC.CTRL = 0x07; // Enable all interrupts
+        TCD1.PERBUF = per;
+    }
+    else {
+        clrbit(AWGCtrl, awgstream);
+        AWGFlush();                         // The ring overwrote the waves
+        setbit(MStatus, updateawg);
+    }
+    StreamArm();
+    sei();
+}
+
+// Point the EP1 OUT endpoint at the next slot, or at the back buffer
+void AWGReceiveArm(void) {
+    uint8_t *p;
+    uint16_t n;
+    if(testbit(AWGCtrl,awgstream)) {
+        p = AWGWave[0]+StreamWr*STREAM_PACKET;
+        n = STREAM_PACKET;
+    }
+    else {
+        p = AWGWave[AWGBuffer==AWGWave[0]];
+        n = BUFFER_AWG;
+    }
+    endpoints[1].out.DATAPTR = (uint16_t)p;
+    endpoints[1].out.CNT = 0;
+    endpoints[1].out.AUXDATA = n;
+}
+
+// EP1 OUT transaction complete, called from the USB interrupt
+// Without streaming it is a whole wave, play it now as the old firmware did
+// Returns 0 if the ring is full, the endpoint is armed again by the DMA interrupt
+uint8_t AWGReceive(void) {
+    if(testbit(AWGCtrl,awgstream)) {
+        uint8_t n = endpoints[1].out.CNT;
+        if(n) {                             // Zero length packets are skipped
+            StreamLen[StreamWr] = n;
+            StreamWr = (StreamWr+1)&(STREAM_SLOTS-1);
+        }
+        if(StreamLen[StreamWr]) StreamFull = 1;
+        else AWGReceiveArm();
+        if(!StreamPlaying) {                // Starting, or after an underrun
+            uint8_t ready=0;
+            for(uint8_t i=0; i<STREAM_SLOTS; i++) if(StreamLen[i]) ready++;
+            if(ready>=STREAM_START || StreamFull) StreamPlay();
+        }
+        return !StreamFull;
+    }
+    uint8_t *p = (uint8_t *)endpoints[1].out.DATAPTR;
+    if(p!=AWGBuffer) {
+        if(DDSOn) AWGBuffer = p;
+        else if(BurstOn) {
+            AWGPending = 1;                 // Next burst
+            BurstStart();
+        }
+        else {
+            AWGPending = 1;                 // Switch to the other buffer now
+            AWGPlay();
+        }
+    }
+    KeyCycles = 0;                          // The next BuildWave scales again
+    AWGReceiveArm();
+    return 1;
+}
+
+// Receive the next packet in the free slot
+static void StreamArm(void) {
+    StreamFull = 0;
+    AWGReceiveArm();
+    endpoints[1].out.STATUS &= ~(USB_EP_BUSNACK0_bm | USB_EP_BUSNACK1_bm);
+}
+
+// Play the slot at StreamRd
+static void StreamPlay(void) {
+    uint8_t *p = AWGWave[0]+StreamRd*STREAM_PACKET;
+    DMA.CH3.TRFCNT    = StreamLen[StreamRd];
+	DMA.CH3.SRCADDR0  = (((uint16_t) p)>>0*8) & 0xFF;
+	DMA.CH3.SRCADDR1  = (((uint16_t) p)>>1*8) & 0xFF;
+    DMA.CH3.CTRLB     = 0x13;           // Clear the transaction flag, high level interrupt
+    DMA.CH3.CTRLA     = 0b10000100;     // Enable CH3, 1 byte burst, single
+    StreamPlaying = 1;
 }
@@ -3,13 +3,89 @@
 
 #include "main.h"
 
+// M.AWGtype values after the built in waves
+#define AWG_HARMONIC 6      // Sum of HARMONICS harmonics, HarmAmp and HarmPhase
+#define HARMONICS   16      // Harmonics in the synthesis, the first is the fundamental
+
+// NoiseCtrl values, for the noise wave type
+#define NOISE_TABLE 0       // 256 random samples, repeated
+#define NOISE_WHITE 1       // Continuous, xorshift generator
+#define NOISE_PINK  2       // Continuous, Voss-McCartney
+#define NOISE_BAND  3       // Continuous, white through two low pass poles at the AWG frequency
+#define NOISE_ROWS  12      // Pink noise generator rows, the lowest updates every 4096 samples
+
+// AWGCtrl bits
+#define awgdds      0       // DDS engine, up to DDS_MAXF
+#define awgstream   1       // Samples streamed from the host
+#define awgburst    2       // AWGBurst cycles, then the DAC stays at the offset
+#define awgtrig     3       // Each burst waits for the trigger
+
+#define DDS_PER     511     // DAC rate with the DDS engine: 32MHz/512 = 62.5kHz
+#define DDS_MAXF    625000  // Highest DDS frequency, Hz*100: 10 samples per cycle
+#define DDS_BLOCK   64      // Samples per DMA block
+
+// ModCtrl bits
+#define modtype     0x03    // Mask: modulation, MOD_OFF to MOD_PWM
+#define modwave     0x0C    // Mask: modulating wave, MOD_SINE to MOD_TRIANGLE
+#define MOD_OFF     0
+#define MOD_AM      1
+#define MOD_FM      2
+#define MOD_PWM     3
+#define MOD_SINE    0x00
+#define MOD_SQUARE  0x04
+#define MOD_TRIANGLE 0x08
+#define MOD_RATES   13      // Modulation rates, 0.1Hz to 1kHz
+#define MOD_STEP    8       // Samples per modulation update
+
+#define TRIG_MINPER 63      // Fastest triggered burst rate: 32MHz/64 = 500kHz
+#define TRIG_FIX    12      // Cycles from reading to writing CNT in the trigger interrupt
+
+// SweepCtrl bits
+#define swtype      0x03    // Mask: frequency sweep, SWEEP_LINEAR to SWEEP_LIST
+#define SWEEP_LINEAR 0      // One step per frame, in MSO()
+#define SWEEP_LOG   1       // Timed, M.SWSpeed/256 of an octave per step
+#define SWEEP_LIST  2       // Timed, M.SWSpeed steps per frequency of the list
+#define swmarker    2       // Marker on the EXT TRIG pin
+#define SWEEP_LIST_MAX  32  // Frequencies in the list
+#define SWEEP_SCALE 17      // Log steps per M.Sweep1, M.Sweep2 unit: 1Hz to 125kHz
+
+#define STREAM_PACKET   64                  // Bytes per EP1 OUT packet
+#define STREAM_SLOTS    (2*BUFFER_AWG/STREAM_PACKET)    // Packets in the ring, a power of 2
+#define STREAM_START    (STREAM_SLOTS/2)    // Packets received before the playback starts
+#define STREAM_MINPER   249                 // Fastest streaming rate: 32MHz/250 = 128kHz, the ring holds 4ms
+
 void moveF(void);
 void LoadAWGvars(void);
 void SaveAWGvars(void);
 void BuildWave(void);
+void AWGFlush(void);        // Build the whole wave on the next BuildWave
+void AWGDMAInit(void);      // DMA from the AWG buffer to the DAC
+uint32_t AWGFrequency(void);    // Actual frequency, Hz*100
+uint32_t ModFrequency(void);    // Modulation rate, Hz*100
+void AWGStream(uint16_t per);   // Play the samples from the host at 32MHz/(per+1), stop if 0
+void AWGReceiveArm(void);   // Set the EP1 OUT endpoint for the next wave or packet
+uint8_t AWGReceive(void);   // EP1 OUT transaction complete, returns 0 to NAK the next packet
+void SweepRun(uint8_t on);  // Start or stop the timed frequency sweep
+void SweepTick(void);       // Next step of the timed sweep, every 40.96ms
+uint32_t SweepLogF(uint16_t p); // Log sweep frequency at p/256 octaves from 1Hz, Hz*100
+uint8_t SweepPixel(void);   // Position of the timed sweep, 0 to 127
+uint8_t SweepAdd(uint32_t f);   // Add to the frequency list, 0 clears it, returns the length
 
 // Global AWG variable
-extern uint8_t  AWGBuffer[BUFFER_AWG];
+extern uint8_t * volatile AWGBuffer;    // Buffer playing, BUFFER_AWG bytes
 extern uint8_t  cycles;     // Cycles in AWG buffer
+extern uint8_t  AWGCtrl;    // AWG engine options
+extern uint8_t  ModCtrl;    // Modulation type and modulating wave
+extern uint8_t  ModOff;     // Modulation set, but the frequency is above DDS_MAXF
+extern uint8_t  ModRate;    // Modulation rate, index to the 1-2-5 steps
+extern uint8_t  ModDepth;   // Modulation depth, %: AM depth, FM deviation, PWM duty swing
+extern uint16_t StreamUnderruns;    // Times the stream ran out of samples
+extern uint8_t  AWGBurst;   // Cycles per burst, 1 to 255
+extern uint8_t  NoiseCtrl;  // Noise generator
+extern uint8_t  HarmAmp[HARMONICS];     // Amplitude of each harmonic, %
+extern uint16_t HarmPhase[HARMONICS];   // Phase of each harmonic, degrees
+extern uint8_t  SweepCtrl;  // Frequency sweep type and marker
+extern uint8_t  SweepLen;   // Frequencies in the sweep list
+extern volatile uint8_t AWGTrigger; // DMA CH3 CTRLA for the scope trigger to start the burst, 0 if not armed
 
 #endif
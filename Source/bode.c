@@ -0,0 +1,312 @@
+// Bode plot / Network analyzer
+// The AWG steps through log spaced frequencies, CH1 measures the input and CH2
+// the output of the circuit under test. A single bin DFT at the AWG frequency
+// gives the amplitude and phase of each channel on every point.
+#include <avr/io.h>
+#include <util/delay.h>
+#include <avr/pgmspace.h>
+#include "main.h"
+#include "mso.h"
+#include "awg.h"
+#include "bode.h"
+#include "spectrum.h"
+
+// Function prototypes
+static uint32_t BodeFreq(uint8_t point);
+static uint8_t  Measure(uint8_t point);
+static int8_t   Range(const int8_t *p, uint8_t gain);
+static void     Correlate(const int8_t *buf, uint16_t start, uint16_t n, uint16_t inc, int32_t *re, int32_t *im);
+static int16_t  Log2Mag(int32_t re, int32_t im);
+static uint8_t  GainY(int16_t gain);
+static uint8_t  PhaseY(int16_t phase);
+static void     DrawBode(uint8_t points, uint8_t cursor);
+
+// One decade of log spaced frequencies: 1000*10^(i/32) -> 10Hz to 93.06Hz, in Hz*100
+const uint16_t BodeDecade[32] PROGMEM = {
+    1000, 1075, 1155, 1241, 1334, 1433, 1540, 1655, 1778, 1911, 2054, 2207, 2371, 2548, 2738, 2943,
+    3162, 3398, 3652, 3924, 4217, 4532, 4870, 5233, 5623, 6043, 6494, 6978, 7499, 8058, 8660, 9306
+};
+
+// atan(i/32), 65536 = 360 degrees
+const uint16_t AtanTable[33] PROGMEM = {
+       0,  326,  651,  975, 1297, 1617, 1933, 2246, 2555, 2860, 3159, 3453, 3742, 4025, 4302, 4572,
+    4836, 5094, 5344, 5589, 5826, 6058, 6282, 6500, 6712, 6917, 7117, 7310, 7498, 7679, 7856, 8026,
+    8192
+};
+
+void Bode(void) {
+    uint8_t point=0, cursor=0, run=1;
+    // Save the settings that the sweep modifies
+    uint8_t  oldSrate=Srate, oldCHD=CHDctrl, oldSweep=Sweep;
+    uint8_t  oldgain1=M.CH1gain, oldgain2=M.CH2gain;
+    uint8_t  oldtype=M.AWGtype, oldduty=M.AWGduty;
+    uint32_t oldF=M.AWGdesiredF;
+    uint8_t  oldFFTSize=FFTSize, oldFFTZoom=FFTZoom;
+    clrbit(CHDctrl, digchon);       // Logic DMA channel is not needed
+    FFTSize=FFT_256; FFTZoom=0;     // Both channels in 512 byte buffers
+    Sweep=0;                        // No AWG sweep
+    M.AWGtype=1;                    // Sine wave
+    M.AWGduty=128;                  // 50% duty cycle, undistorted sine
+    T.SCOPE.BODE.points=0;
+    setbit(MStatus, updatemso);
+    clrbit(Misc, userinput);
+    for(;;) {
+        if(run) {
+            if(point==0) {          // New sweep, start from the user's gains
+                M.CH1gain=oldgain1;
+                M.CH2gain=oldgain2;
+                setbit(MStatus, updatemso);
+            }
+            if(Measure(point)) {
+                point++;
+                T.SCOPE.BODE.points=point;
+                if(point>=BODE_POINTS) run=0;   // Sweep complete
+            }
+        }
+        clr_display();
+        DrawBode(point, cursor);
+        lcd_goto(0,TEXT_LAST_LINE);
+        if(run) print3x6(PSTR("STOP"));
+        else print3x6(PSTR("START"));
+        tiny_printp(56,TEXT_LAST_LINE,PSTR("MOVE-        MOVE+"));
+        if(testbit(Misc,keyrep) && (testbit(Buttons,K2) || testbit(Buttons,K3))) setbit(Misc, userinput);   // Repeat key
+        if(testbit(Misc,userinput)) {
+            clrbit(Misc, userinput);
+            if(testbit(Buttons,KML)) break;     // Exit
+            if(testbit(Buttons,K1)) {           // Stop or restart sweep
+                if(run) run=0;
+                else { run=1; point=0; T.SCOPE.BODE.points=0; }
+            }
+            if(testbit(Buttons,K2)) {           // Move cursor left
+                if(cursor) cursor--;
+            }
+            if(testbit(Buttons,K3)) {           // Move cursor right
+                if(cursor<BODE_POINTS-1) cursor++;
+            }
+        }
+        dma_display();
+        WaitDisplay();
+        if(!run) SLP();     // Sleep
+    }
+    // Restore settings
+    Srate=oldSrate; CHDctrl=oldCHD; Sweep=oldSweep;
+    M.CH1gain=oldgain1; M.CH2gain=oldgain2;
+    M.AWGtype=oldtype; M.AWGduty=oldduty;
+    M.AWGdesiredF=oldF;
+    FFTSize=oldFFTSize; FFTZoom=oldFFTZoom;
+    Buttons=0;
+    setbit(MStatus, update);
+    setbit(MStatus, updatemso);
+    setbit(MStatus, updateawg);
+}
+
+// Frequency of a point, in Hz*100
+static uint32_t BodeFreq(uint8_t point) {
+    return (uint32_t)pgm_read_word_near(BodeDecade+(point&0x1F))*pgm_read_dword_near(Powersof10+(point>>5));
+}
+
+// Measure one point, returns 0 if the user interrupted the measurement
+static uint8_t Measure(uint8_t point) {
+    uint32_t f, fs;
+    uint16_t inc, n, start;
+    uint8_t  s, tries=8;
+    int32_t  re1, im1, re2, im2;
+    M.AWGdesiredF = BodeFreq(point);
+    BuildWave();
+    f = AWGFrequency();         // Actual AWG frequency, Hz*100
+    // Fastest sampling rate that fits at least 4 cycles in the 512 sample buffer
+    // Srate 0 has the same ADC clock as Srate 1, use Srate 1 and above
+    for(s=1; ; s++) {
+        fs = pgm_read_dword_near(freqval+s);
+        if(s>=7) fs/=1000;                  // Sampling rate, Hz*100
+        inc = (f<<8)/(fs>>7);               // Phase increment per sample (x2 oversampling), 65536 = 1 cycle
+        if(inc>=512 || s==10) break;
+    }
+    if(Srate!=s) {
+        Srate=s;
+        setbit(MStatus, updatemso);
+    }
+    do {
+        if(testbit(MStatus, updatemso)) Apply();
+        // Let the circuit settle for 3 periods
+        uint16_t wait = 300000UL/f + 2;
+        do {
+            delay_ms(1);
+            if(testbit(Misc,userinput)) return 0;
+        } while(--wait);
+        clrbit(MStatus, update);
+        StartDMAs();                        // Capture one buffer
+        TCE1.CTRLA = 0;
+        ADCA.CTRLB = 0x14;                  // signed mode, no free run, 8 bit
+        ADCB.CTRLB = 0x14;                  // signed mode, no free run, 8 bit
+        _delay_us(80);                      // Wait to process ADC pipeline
+        clrbit(DMA.CH0.CTRLA, 7);
+        clrbit(DMA.CH1.CTRLA, 7);
+        if(testbit(MStatus, update)) return 0;  // User is interacting
+        // Auto range
+        int8_t adj1=Range(T.SCOPE.TempCH1, M.CH1gain);
+        int8_t adj2=Range(T.SCOPE.TempCH2, M.CH2gain);
+        if(adj1==0 && adj2==0) break;
+        M.CH1gain+=adj1;
+        M.CH2gain+=adj2;
+        setbit(MStatus, updatemso);
+    } while(--tries);
+    start=512-DMA.CH0.TRFCNT;               // Oldest sample in the circular buffer
+    // Use an integer number of cycles
+    s = inc>>7;                             // Cycles in the buffer
+    if(s==0) s=1;
+    n = ((uint32_t)s<<16)/inc;
+    if(n>512) n=512;
+    Correlate(T.SCOPE.TempCH1, start, n, inc, &re1, &im1);
+    Correlate(T.SCOPE.TempCH2, start, n, inc, &re2, &im2);
+    // Gain: 20*log10(|CH2|/|CH1|), corrected by the ADC gains and the probes
+    int16_t d = Log2Mag(re2,im2) - Log2Mag(re1,im1) + (((int16_t)M.CH1gain-M.CH2gain)<<8);
+    int16_t gain = ((int32_t)d*15413)>>16;  // log2 (8.8) -> dB*10
+    if(testbit(CH2ctrl,chx10)) gain+=200;
+    if(testbit(CH1ctrl,chx10)) gain-=200;
+    T.SCOPE.BODE.gain[point] = gain;
+    // Phase: CH2 - CH1, degrees*10
+    int16_t phase = Atan2(im2,re2) - Atan2(im1,re1);
+    T.SCOPE.BODE.phase[point] = ((int32_t)phase*225)>>12;
+    return 1;
+}
+
+// Check the signal range, returns -1 if clipping, 1 if too small
+static int8_t Range(const int8_t *p, uint8_t gain) {
+    int8_t max=-128, min=127;
+    uint16_t i=512;
+    do {
+        int8_t v=*p++;
+        if(v>max) max=v;
+        if(v<min) min=v;
+    } while(--i);
+    if(max>=126 || min<=-127) {
+        if(gain) return -1;
+    }
+    else if((int16_t)max-min<48 && gain<6) return 1;
+    return 0;
+}
+
+// Single bin DFT of n samples from the circular buffer, mean removed
+static void Correlate(const int8_t *buf, uint16_t start, uint16_t n, uint16_t inc, int32_t *re, int32_t *im) {
+    int32_t sum=0, r=0, q=0;
+    uint16_t i, j, phase=0;
+    int8_t mean;
+    j=start; i=n;
+    do {
+        sum+=buf[j];
+        j=(j+1)&511;
+    } while(--i);
+    mean=sum/n;
+    j=start; i=n;
+    do {
+        int16_t x=buf[j]-mean;
+        uint8_t a=hibyte(phase);
+        r+=x*Cos(a);
+        q+=x*Sin(a);
+        phase+=inc;
+        j=(j+1)&511;
+    } while(--i);
+    *re=r;
+    *im=-q;
+}
+
+// log2 of the magnitude, 8.8 fixed point
+static int16_t Log2Mag(int32_t re, int32_t im) {
+    uint8_t shift=0, e=31;
+    uint16_t m, frac=0;
+    uint32_t x;
+    if(re<0) re=-re;
+    if(im<0) im=-im;
+    while((re|im)>=32768) { re>>=1; im>>=1; shift++; }
+    x=(uint32_t)re*re+(uint32_t)im*im;
+    if(x==0) return 0;
+    while(!(x&0x80000000)) { x<<=1; e--; }
+    m=x>>16;                    // Mantissa, 1.15 fixed point
+    for(uint8_t i=8; i; i--) {  // Fractional bits by repeated squaring
+        uint32_t sq=(uint32_t)m*m;
+        frac<<=1;
+        if(sq&0x80000000) { frac|=1; m=sq>>16; }
+        else m=sq>>15;
+    }
+    return ((((int16_t)e<<8)+frac)>>1)+((int16_t)shift<<8);   // sqrt -> divide by 2
+}
+
+// Angle of (x,y), 65536 = 360 degrees
+uint16_t Atan2(int32_t y, int32_t x) {
+    uint32_t ax, ay, r;
+    uint16_t a;
+    uint8_t k;
+    ax = (x<0) ? -x : x;
+    ay = (y<0) ? -y : y;
+    if((ax|ay)==0) return 0;
+    while((ax|ay)>=0x40000) { ax>>=1; ay>>=1; }
+    if(ay>ax) r=(ax<<13)/ay;    // Ratio <= 1, 3.13 fixed point
+    else      r=(ay<<13)/ax;
+    k=r>>8;                     // Table index, ratio*32
+    a=pgm_read_word_near(AtanTable+k);
+    if(k<32) a+=((uint32_t)(pgm_read_word_near(AtanTable+k+1)-a)*lobyte(r))>>8;
+    if(ay>ax) a=16384-a;        // Second octant
+    if(x<0) a=32768-a;          // Left half
+    if(y<0) a=-a;               // Lower half
+    return a;
+}
+
+// Gain plot: +20dB at the top, 10dB every 8 pixels
+static uint8_t GainY(int16_t gain) {
+    int16_t y=24-(gain*2)/25;
+    if(y<8) y=8;
+    if(y>71) y=71;
+    return y;
+}
+
+// Phase plot: +-180 degrees around line 96
+static uint8_t PhaseY(int16_t phase) {
+    return 96-phase/113;
+}
+
+static void DrawBode(uint8_t points, uint8_t cursor) {
+    uint8_t i, y, p, oldy=0, oldp=0;
+    // Grid
+    for(i=0; i<128; i+=4) {
+        for(y=8; y<72; y+=16) set_pixel(i,y);   // 20dB divisions
+        set_pixel(i,96);                        // 0 degrees
+    }
+    for(i=32; i<128; i+=32) {                   // Decades
+        for(y=8; y<112; y+=4) set_pixel(i,y);
+    }
+    tiny_printp(0,9,PSTR("10HZ    100HZ   1KHZ    10KHZ"));
+    // Traces
+    for(i=0; i<points; i++) {
+        int16_t phase=T.SCOPE.BODE.phase[i];
+        y=GainY(T.SCOPE.BODE.gain[i]);
+        p=PhaseY(phase);
+        if(i) {
+            set_line(i-1,oldy,i,y);
+            int16_t dp=phase-T.SCOPE.BODE.phase[i-1];
+            if(dp<1800 && dp>-1800) set_line(i-1,oldp,i,p);
+            else set_pixel(i,p);                // Phase wrapped
+        }
+        else {
+            set_pixel(0,y);
+            set_pixel(0,p);
+        }
+        oldy=y; oldp=p;
+    }
+    // Cursor
+    for(y=10; y<112; y+=4) set_pixel(cursor,y);
+    if(cursor<points) {
+        uint32_t f=BodeFreq(cursor);
+        if(f>=100000) {
+            printF(0,0,f);
+            print3x6(STR_KHZ);                  // "KHZ"
+        }
+        else {
+            printF(0,0,f*1000);
+            print3x6(STR_KHZ+1);                // "HZ"
+        }
+        printF(44,0,(int32_t)T.SCOPE.BODE.gain[cursor]*10000);
+        print3x6(PSTR("DB"));
+        printF(88,0,(int32_t)T.SCOPE.BODE.phase[cursor]*10000);
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef _BODE_H
+#define _BODE_H
+
+#include <stdint.h>
+
+// Bode plot: BODE_POINTS log spaced points from 10Hz, 32 points per decade
+void Bode(void);               // Network analyzer mode
+uint16_t Atan2(int32_t y, int32_t x);   // Angle of the vector, 65536 = 360 degrees
+
+#endif
@@ -139,7 +139,7 @@ const NVMVAR MAXM PROGMEM = {   // Flash Copy
     255,    //  Sweep2;         //
     127,    //  SWSpeed;        // Sweep Speed Max
     255,    //  AWGamp;         //
-    5,      //  AWGtype;        // 6 waveform types
+    6,      //  AWGtype;        // 7 waveform types
     255,    //  AWGduty;        //
     255,    //  AWGoffset;      //
     0x00BEFFFF,  //  AWGdesiredF;    // Max set to 125.17375kHz
@@ -181,6 +181,52 @@ const int8_t Blackman[128] PROGMEM = {
     120,121,122,123,123,124,125,125,126,126,127,127,127,127,127,127,
 };
 
+// Flat top window = 0.21557895 -0.41663158*cos(2*PI*n/(FFT_N-1)) +0.277263158*cos(4*PI*n/(FFT_N-1))
+//                  -0.083578947*cos(6*PI*n/(FFT_N-1)) +0.006947368*cos(8*PI*n/(FFT_N-1))
+const int8_t FlatTop[128] PROGMEM = {
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, -1, -1,
+     -1, -1, -1, -1, -1, -1, -1, -2, -2, -2, -2, -2, -2, -3, -3, -3,
+     -3, -4, -4, -4, -5, -5, -5, -5, -6, -6, -6, -7, -7, -7, -8, -8,
+     -8, -8, -8, -9, -9, -9, -9, -9, -9, -9, -9, -9, -8, -8, -8, -7,
+     -7, -6, -6, -5, -4, -3, -2, -1,  0,  2,  3,  4,  6,  8, 10, 12,
+     14, 16, 18, 20, 23, 25, 28, 30, 33, 36, 39, 42, 45, 48, 51, 54,
+     58, 61, 64, 67, 71, 74, 77, 80, 83, 87, 90, 93, 96, 98,101,104,
+    106,109,111,113,115,117,119,120,122,123,124,125,126,126,127,127,
+};
+
+// Kaiser window = I0(8*SQRT(1-(2*n/(FFT_N-1)-1)^2))/I0(8), beta = 8
+const int8_t Kaiser[128] PROGMEM = {
+      0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  2,  2,  2,  2,  2,  3,
+      3,  3,  4,  4,  4,  5,  5,  6,  6,  7,  7,  8,  8,  9,  9, 10,
+     11, 11, 12, 13, 14, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+     25, 26, 28, 29, 30, 31, 33, 34, 35, 37, 38, 40, 41, 43, 44, 46,
+     47, 49, 50, 52, 54, 55, 57, 59, 60, 62, 64, 66, 67, 69, 71, 72,
+     74, 76, 78, 79, 81, 83, 85, 86, 88, 90, 91, 93, 95, 96, 98, 99,
+    101,102,104,105,107,108,109,110,112,113,114,115,116,117,118,119,
+    120,121,122,123,123,124,124,125,125,126,126,126,127,127,127,127,
+};
+
+// Quarter sine wave, 1024 steps per cycle, Q15
+const int16_t SinQ15[257] PROGMEM = {
+         0,   201,   402,   603,   804,  1005,  1206,  1407,  1608,  1809,  2009,  2210,  2410,  2611,  2811,  3012,
+      3212,  3412,  3612,  3811,  4011,  4210,  4410,  4609,  4808,  5007,  5205,  5404,  5602,  5800,  5998,  6195,
+      6393,  6590,  6786,  6983,  7179,  7375,  7571,  7767,  7962,  8157,  8351,  8545,  8739,  8933,  9126,  9319,
+      9512,  9704,  9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+     12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828, 14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+     15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+     18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+     20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856, 22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+     23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+     25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+     27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001, 28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+     28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+     30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+     31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736, 31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+     32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+     32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+     32767,
+};
+
 const int8_t Exp[128] PROGMEM = {      // AWG Exponential
     -117,-107, -97, -87, -78, -69, -61, -53, -45, -38, -31, -24, -18, -12,  -6,   0,
        5,  11,  16,  20,  25,  29,  33,  37,  41,  45,  49,  52,  55,  58,  61,  64,
@@ -19,6 +19,9 @@ extern uint8_t EEMEM EEGPIO[12];
 extern const int8_t Hamming[128];
 extern const int8_t Hann[128];
 extern const int8_t Blackman[128];
+extern const int8_t FlatTop[128];
+extern const int8_t Kaiser[128];
+extern const int16_t SinQ15[257];
 extern const int8_t Exp[128];
 extern int8_t EEMEM EEwave[256];
 extern uint8_t EEMEM EEGPIO_User[8][12];
@@ -54,6 +54,7 @@ void bitmap_safe(int8_t x, int8_t y, const uint8_t *BMP, uint8_t c);
 
 void GLCD_LcdInit(void);
 void LCD_PrepareBuffers(void);
+void LCD_LineAddresses(uint8_t *setup, uint8_t first);
 void dma_display(void);
 void WaitDisplay(void);
 
@@ -5,6 +5,7 @@
 #define HARDWARE_H
 
 //#define INVERT_DISPLAY
+//#define PROFILE PROFILE_SHAPE     // White LED pin high while the selected code runs
 
 #include "LS013B7DH03.h"
 
@@ -13,8 +14,12 @@
 #define LCD_LINES           16          // Text lines on the display
 #define BUFFER_SERIAL       1280        // Buffer size for SPI or UART Sniffer
 #define BUFFER_I2C          2048        // Buffer size for the I2C sniffer
+#define BUFFER_RAW          1536        // Samples waiting for the UART TX or SPI MISO decoder
 #define DATA_IN_PAGE_I2C    128         // Data that fits on a page in the sniffer
 #define DATA_IN_PAGE_SERIAL 80          // Data that fits on a page in the sniffer
+#define BODE_POINTS         128         // Frequency points in a Bode sweep
+#define REF_SLOTS           4           // Reference waveform slots
+#define REF_POOL            640         // EEPROM bytes for the compressed reference slots
 
 #define LCDVDD              5           // LCD VDD
 #define LCD_DISP            2           // DISPLAY ON / OFF
@@ -45,6 +50,20 @@
 #define BATT_TEST_ON()  setbit(VPORT1.OUT, BATT_CIR)
 #define BATT_TEST_OFF() clrbit(VPORT1.OUT, BATT_CIR)
 #define TOGGLE_RED()    PORTE.OUTTGL = 0x04
+// Timing on a scope: the pin is high for the code selected by PROFILE,
+// the high time in us * 32 is the cycles it took
+#define PROFILE_SHAPE       1           // BuildWave: shape and duty cycle
+#define PROFILE_SCALE       2           // BuildWave: gain and offset
+#define PROFILE_TIMING      3           // BuildWave: timer period or DDS increment
+#define PROFILE_DDS         4           // DDS block refill, the duty cycle is the CPU load
+#define PROFILE_DECODE      5           // Sniffer UART TX or SPI MISO decoder, every 1ms
+#ifdef PROFILE
+#define PROFILE_ON(n)   do { if(PROFILE==(n)) ONWHITE(); } while(0)
+#define PROFILE_OFF(n)  do { if(PROFILE==(n)) OFFWHITE(); } while(0)
+#else
+#define PROFILE_ON(n)
+#define PROFILE_OFF(n)
+#endif
 #define ANALOG_ON()     setbit(VPORT0.OUT, ANPOW)
 #define ANALOG_OFF()    clrbit(VPORT0.OUT, ANPOW)
 #define LOGIC_ON()      PORTA.OUTSET = 0x02
@@ -8,6 +8,7 @@
 #include "display.h"
 #include "awg.h"
 #include "interface.h"
+#include "spectrum.h"
 #include "usb\usb_xmega.h"
 #include "config.h"
 
@@ -208,6 +209,7 @@ uint8_t ProcessCommand(uint8_t Command, uint8_t usb) {
 		case 'e':   // Save AWG in RAM to EE
             OFFRED();
 		    eeprom_write_block(AWGBuffer, EEwave, 256);
+            AWGFlush();     // The custom wave changed
 		break;
         case 'f':   // Stop
             setbit(MStatus,update);
@@ -263,7 +265,89 @@ uint8_t ProcessCommand(uint8_t Command, uint8_t usb) {
             setbit(MStatus, updateawg);
             send('T');   // confirmation
         break;
+        case 'S':   // AWG stream: timer period (2 bytes), 0 stops, 0xFFFF only reads. Send the underruns
+            if(usb) {
+                index=lobyte(req->wValue);
+                value=hibyte(req->wValue);
+            } else {
+                index=read();
+                value=read();
+            }
+            ep0_buf_in[0]=lobyte(StreamUnderruns);
+            ep0_buf_in[1]=hibyte(StreamUnderruns);
+            if(index!=0xFF || value!=0xFF) AWGStream(((uint16_t)value<<8) | index);
+            if(usb) n=2;
+            else {
+                send(ep0_buf_in[0]);
+                send(ep0_buf_in[1]);
+            }
+        break;
+        case 'H':   // Set a harmonic: index, amplitude (%), phase (degrees, 2 bytes)
+            if(usb) {
+                index=lobyte(req->wIndex);
+                value=hibyte(req->wIndex);
+                i=lobyte(req->wValue);
+                n=hibyte(req->wValue);
+            } else {
+                index=read();
+                value=read();
+                i=read();
+                n=read();
+            }
+            if(index<HARMONICS) {
+                HarmAmp[index]=(value>100) ? 100 : value;
+                HarmPhase[index]=(((uint16_t)n<<8) | i)%360;
+                if(M.AWGtype==AWG_HARMONIC) AWGFlush();    // Build the shape again
+                setbit(MStatus, updateawg);
+            }
+            n=0;
+        break;
+        case 'L':   // Sweep list: add a frequency (4 bytes), 0 clears, 0xFFFFFFFF only reads. Send the length and the frequency playing
+            {
+                uint32_t f;
+                p=(uint8_t *)&f;
+                if(usb) {
+                    *p++=lobyte(req->wIndex);
+                    *p++=hibyte(req->wIndex);
+                    *p++=lobyte(req->wValue);
+                    *p++=hibyte(req->wValue);
+                } else for(;i<4;i++) *p++=read();
+                ep0_buf_in[0]=(f==0xFFFFFFFF) ? SweepLen : SweepAdd(f);
+                p=(uint8_t *)&M.AWGdesiredF;
+                for(i=1; i<5; i++) ep0_buf_in[i]=*p++;
+            }
+            if(usb) n=5;
+            else for(i=0; i<5; i++) send(ep0_buf_in[i]);
+        break;
+        case 'B':   // Send Bode plot: gain (dB*10), phase (degrees*10)
+            if(usb) {   // 16 points starting at wIndex, a short packet marks the end
+                index=lobyte(req->wIndex);
+                for(; i<16 && index<T.SCOPE.BODE.points; i++, index++) {
+                    ep0_buf_in[n++]=lobyte(T.SCOPE.BODE.gain[index]);
+                    ep0_buf_in[n++]=hibyte(T.SCOPE.BODE.gain[index]);
+                    ep0_buf_in[n++]=lobyte(T.SCOPE.BODE.phase[index]);
+                    ep0_buf_in[n++]=hibyte(T.SCOPE.BODE.phase[index]);
+                }
+            }
+            else {      // Number of points followed by all the points
+                send(T.SCOPE.BODE.points);
+                for(; i<T.SCOPE.BODE.points; i++) {
+                    send(lobyte(T.SCOPE.BODE.gain[i]));
+                    send(hibyte(T.SCOPE.BODE.gain[i]));
+                    send(lobyte(T.SCOPE.BODE.phase[i]));
+                    send(hibyte(T.SCOPE.BODE.phase[i]));
+                }
+            }
+        break;
         case 'C': SendBMP(); break; // Send BMP
+        case 'D':   // Send distortion analysis: THD, SNR, SINAD (dB*10), ENOB*10, fundamental bin
+            p=(uint8_t *)&Dist;
+            if(usb) {
+                for(; i<9; i++) ep0_buf_in[i]=*p++;
+                n=9;
+            }
+            else for(; i<9; i++) send(*p++);
+        break;
 		case 0xBB: // disconnect from USB, jump to bootloader
             if(usb) {
                 //USB_ep0_wait_for_complete();
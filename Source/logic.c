@@ -6,8 +6,48 @@
 #include "USB\usb_xmega.h"
 #include "utils.h"
 
+// UART TX and SPI MISO: no USART receiver sits on the TX pin (PC3), SCK (PC7)
+// is not the XCK pin of a USART and there is no second SPI on PORTC. Instead,
+// DMA CH1 fills a ring and the TCE0 interrupt decodes it in software every
+// millisecond. There is no interrupt per bit.
+// UART: Event CH2 follows both edges of TX and TCC1, free running at 8MHz,
+// captures their time. The DMA moves each 16 bit capture to the ring. The
+// decoder extends the times to 32 bits, CPU cycles, from the TCC1 count at
+// each TCE0 overflow: 8000 counts apart, known without reading TCC1.CNT,
+// whose TEMP byte the DMA uses for the captures. Between two edges the level
+// is known, so the CPU works once per edge and once per bit of a frame, and
+// not at all while the line is idle. The level read at each run puts the
+// decoder back in step if an edge is lost.
+// SPI: Event CH2 follows the sampling edge of SCK and triggers the DMA. A
+// sample with /SS high ends a frame, the /SS interrupt adds one when the
+// frame ends.
+// The DMA CH1 interrupt counts the laps of the ring. If more than BUFFER_RAW
+// bytes, SPI samples or BUFFER_RAW/2 UART edges, arrive between two decoder
+// runs, the ones not decoded are lost: rawover is set, the decoder skips to
+// the newest one and the display shows '!' under the TX or MISO label.
+#define SPI_SYNC    8           // rawbits: wait for the end of a frame
+#define AUTO_PULSES     256     // UART auto detection: pulses timed
+#define AUTO_MINPULSE   32      // UART auto detection: shorter pulses are glitches, 1us
+#define AUTO_MINBIT     264     // UART auto detection: shortest bit, 5% above 115200 baud
+
 void ConfigLogicDMA(void);
 void DisplayData(uint8_t side, uint8_t page);
+static uint16_t TxIndex(void);
+static uint16_t RawWrite(void);
+static void DecodeMISO(void);
+static void DecodeTX(void);
+static void UARTEdge(uint32_t t);
+static void UARTUntil(uint32_t t);
+static void UARTBit(void);
+static void StopTCE0(void);
+static uint8_t IdleLevel(uint8_t pin);
+static uint16_t Pulses(uint8_t pin, uint16_t *width);
+static uint16_t BitTime(const uint16_t *width, uint16_t n);
+static uint8_t BaudIndex(uint16_t bit);
+static uint16_t BitPeriod(void);
+static void USARTBaud(uint16_t bit);
+static uint8_t Samples(uint8_t pin);
+static uint8_t FrameTest(uint8_t format);
 
 //    0   1   2   3   4   5   6   7
 //  |...|...|...|...|...|...|...|...|
@@ -82,6 +122,9 @@ const uint8_t BAUDB[8] PROGMEM = {
     164     // 115200
 };
 
+uint16_t UARTCustom;    // Bit time in CPU cycles of a detected baud rate not in the menu, 0 if none
+uint8_t UARTInvert;     // The detected lines idle low with the logic input setting, the sniffer inverts them
+
 const uint16_t TCC1val[8] PROGMEM = {
     26665,  // 1200
     13332,  // 2400
@@ -136,17 +179,53 @@ void ConfigLogicDMA(void) {
         DMA.CH0.CTRLA     = 0b10100100;   // repeat, 1 byte burst
     }
 
-    // For UART and SPI Sniffer, bit-bang / DMA:
-    DMA.CH1.ADDRCTRL  = 0b10000101;     // reload source addr after each burst, incr dest, reload dest end block
-    DMA.CH1.TRFCNT    = BUFFER_SERIAL;            // buffer size
-    DMA.CH1.DESTADDR0 = (((uint16_t) T.LOGIC.data.Serial.TX)     ) & 0xFF;
-    DMA.CH1.DESTADDR1 = (((uint16_t) T.LOGIC.data.Serial.TX)>>1*8) & 0xFF;
-    //DMA.CH1.TRIGSRC   = 0x00;               // Manual
-    DMA.CH1.SRCADDR0  = (((uint16_t)(&T.LOGIC.addr_ack_pos))     ) & 0xFF;
-    DMA.CH1.SRCADDR1  = (((uint16_t)(&T.LOGIC.addr_ack_pos))>>1*8) & 0xFF;
-
-    if(testbit(Mcursors, singlesniff)) DMA.CH1.CTRLA     = 0b10000100;    // no repeat, 1 byte burst
-    else DMA.CH1.CTRLA     = 0b10100100;                            // repeat, 1 byte burst
+    // For UART TX and SPI MISO, sample PORTC:
+    if(M.CHDdecode == i2c) return;      // I2C is decoded in the PORTC interrupt
+    cli();                          // The decoder may be running
+    T.LOGIC.rawtx = 0;
+    T.LOGIC.rawpos = 0;
+    T.LOGIC.rawbits = 0;
+    T.LOGIC.rawwait = 0;
+    T.LOGIC.rawlaps = 0;
+    T.LOGIC.rawover = 0;
+    T.LOGIC.rawlevel = testbit(VPORT2.IN,3)? 1: 0;
+    TCE0.INTFLAGS = TC0_OVFIF_bm;   // The next decoder run is at the next overflow
+    T.LOGIC.rawcnt = (32000-TCE0.CNT)/4;
+    T.LOGIC.rawcnt += TCC1.CNT;     // DMA CH1 is off, TEMP is free
+    T.LOGIC.rawtime = 0;
+    T.LOGIC.rawedge = 0;
+    sei();
+    DMA.CH1.TRFCNT    = BUFFER_RAW;     // buffer size
+    DMA.CH1.DESTADDR0 = (((uint16_t) T.LOGIC.raw)     ) & 0xFF;
+    DMA.CH1.DESTADDR1 = (((uint16_t) T.LOGIC.raw)>>1*8) & 0xFF;
+    DMA.CH1.CTRLB     = 0x13;           // Clear the transaction flag, high level interrupt: ring laps
+    if(M.CHDdecode == spi) {
+        T.LOGIC.rawbits = SPI_SYNC;
+        DMA.CH1.ADDRCTRL  = 0b10000101; // reload source addr after each burst, incr dest, reload dest end block
+        DMA.CH1.TRIGSRC   = 0x03;       // Event CH2: SCK
+        DMA.CH1.SRCADDR0  = (((uint16_t)(&PORTC.IN))     ) & 0xFF;
+        DMA.CH1.SRCADDR1  = (((uint16_t)(&PORTC.IN))>>1*8) & 0xFF;
+        DMA.CH1.CTRLA     = 0b10100100; // repeat, 1 byte burst, the decoder stops a single sniff
+    }
+    else {
+        DMA.CH1.ADDRCTRL  = 0b10010101; // reload source addr after each burst, incr source and dest, reload dest end block
+        DMA.CH1.TRIGSRC   = 0x48;       // TCC1 CCA: a TX edge
+        DMA.CH1.SRCADDR0  = (((uint16_t)(&TCC1.CCA))     ) & 0xFF;
+        DMA.CH1.SRCADDR1  = (((uint16_t)(&TCC1.CCA))>>1*8) & 0xFF;
+        (void)TCC1.CCA;                 // Drop the edges before the DMA runs
+        (void)TCC1.CCA;
+        DMA.CH1.CTRLA     = 0b10100101; // repeat, 2 byte burst, the decoder stops a single sniff
+    }
+    TCE0.INTCTRLA = 0x01;               // Enable TCE0 interrupt, Low Priority
+}
+
+// TX index, the TX or MISO bytes are written by the TCE0 interrupt
+static uint16_t TxIndex(void) {
+    uint16_t i;
+    cli();
+    i=T.LOGIC.rawtx;
+    sei();
+    return i;
 }
 
 // Protocol Sniffer
@@ -165,6 +244,7 @@ void Sniff(void) {
     // Setup
     PR.PRPC  = 0x00;        // Enable PORTC peripherals
     uint8_t spictrl=0;
+    uint8_t ch2mux=EVSYS.CH2MUX;    // Event CH2 takes SCK in the SPI sniffer
     if(M.CHDdecode==i2c) {
         print5x8(PSTR("I2C SNIFFER\nBIT0:SDA BIT1:SCL"));
         T.LOGIC.addr_ack_ptr =  T.LOGIC.data.I2C.addr_ack;
@@ -179,8 +259,11 @@ void Sniff(void) {
         // Initialize USART for RX
         uint8_t baud, databits;
         baud=Sniffer&0x07;
-        USARTC0.BAUDCTRLA = pgm_read_byte_near(BAUDA+baud);
-        USARTC0.BAUDCTRLB = pgm_read_byte_near(BAUDB+baud);
+        if(UARTCustom) USARTBaud(UARTCustom);
+        else {
+            USARTC0.BAUDCTRLA = pgm_read_byte_near(BAUDA+baud);
+            USARTC0.BAUDCTRLB = pgm_read_byte_near(BAUDB+baud);
+        }
         databits=(Sniffer&0x18)>>3;
         T.LOGIC.databits=databits+5;
         if(testbit(Sniffer,parmode)) {     // Check parity
@@ -191,24 +274,42 @@ void Sniff(void) {
         USARTC0.CTRLC = databits;
                 
         USARTC0.CTRLB = 0x10;       // Enable RX
-        TCC1.CTRLA = 0x01;  // DIV1
-        T.LOGIC.baud = (uint16_t)pgm_read_word_near(TCC1val+baud);
-        TCC1.PER = T.LOGIC.baud/4;   // Sample at 4 times the baud rate
-        TCC1.INTCTRLA = 0x03;           // Enable TCC1 interrupt, High Priority
+        if(UARTInvert) {            // Idle low, Apply restores the pins
+            PORTC.PIN2CTRL ^= PORT_INVEN_bm;
+            PORTC.PIN3CTRL ^= PORT_INVEN_bm;
+        }
+        T.LOGIC.baud = BitPeriod();
+        PORTC.PIN3CTRL &= 0xF8;     // Sense both edges of TX
+        EVSYS.CH2MUX = 0x63;        // Event CH2 = PC3 (TX)
+        TCC1.CTRLA = 0;             // Stop timer prior to reset
+        TCC1.CTRLFSET = 0x0F;       // Reset timer
+        TCC1.CTRLB = TC1_CCAEN_bm;  // Capture enable
+        TCC1.CTRLD = 0x2A;          // Input capture on event, Event CH2
+        TCC1.CTRLA = 0x03;          // DIV4, 8.192ms period
     }
     else if(M.CHDdecode==spi) {
         uint8_t pin7ctrl=1;   // Sense rising edge
+        uint8_t pin4ctrl=1;   // Sense rising edge: end of frame
         print5x8(PSTR("SPI SNIFFER\nBIT4:/SS\nBIT5:MOSI\nBIT6:MISO\nBIT7:SCK"));
         if(testbit(Sniffer,CPOL)) {    // CPOL == 1
             pin7ctrl = PORT_INVEN_bm+1;   // Invert SCK, Sense rising edge
         }
         if(testbit(Sniffer,CPHA)) {
             spictrl=0x04;  // CPHA == 1
+            pin7ctrl++;    // Sense falling edge, MISO is sampled on the second edge
         }
         PORTC.PIN7CTRL = pin7ctrl;
         if(testbit(Sniffer,SSINV)) {    // Invert Slave select
-            PORTC.PIN4CTRL = PORT_INVEN_bm;
+            pin4ctrl = PORT_INVEN_bm+1;
         }
+        PORTC.PIN4CTRL = pin4ctrl;
+        EVSYS.CH2MUX = 0;               // No samples until /SS is high
+    }
+    if(M.CHDdecode!=i2c) {
+        TCE0.CTRLA = 0;                 // Stop timer prior to reset
+        TCE0.CTRLFSET = 0x0F;           // Reset timer
+        TCE0.PER = 31999;               // Decode TX or MISO every 1ms
+        TCE0.CTRLA = 0x01;              // DIV1
     }
     ConfigLogicDMA();
     dma_display(); WaitDisplay();
@@ -216,11 +317,12 @@ void Sniff(void) {
         WDR();
         if(M.CHDdecode!=i2c) {
             T.LOGIC.indrx=BUFFER_SERIAL-DMA.CH0.TRFCNT;
-            T.LOGIC.indtx=BUFFER_SERIAL-DMA.CH1.TRFCNT;            
+            T.LOGIC.indtx=TxIndex();
         }            
         if(M.CHDdecode==spi) {
             if(testbit(VPORT2.IN, 4)) {     // SS not asserted
                 SPIC.CTRL = 0b01000000 + spictrl;       // Enable SPI, Slave mode
+                EVSYS.CH2MUX = 0x67;    // Event CH2 = PC7 (SCK), samples MISO
                 PORTC.INTFLAGS = 0x03;  // Clear flags
                 PORTC.INTCTRL   = 0x0C; // Enable PortC INT 1, High Priority
             }                
@@ -297,17 +399,14 @@ void Sniff(void) {
         // Display UART or SPI data
         else {
             T.LOGIC.indrx=BUFFER_SERIAL-DMA.CH0.TRFCNT;
-            T.LOGIC.indtx=BUFFER_SERIAL-DMA.CH1.TRFCNT;
+            T.LOGIC.indtx=TxIndex();
             if(testbit(Mcursors, singlesniff)) {
                 if(!testbit(DMA.CH0.CTRLA, 7)) {    // Hardware decoding complete
                     DMA.CH0.TRFCNT    = 0;
                     USARTC0.CTRLB = 0x00;           // Disable RX
                     clrbit(SPIC.CTRL,6);            // Disable SPI
                 }
-                if(!testbit(DMA.CH1.CTRLA, 7)) {    // Software decoding complete
-                    DMA.CH1.TRFCNT    = 0;
-                    setbit(MStatus, stop);
-                }
+                if(T.LOGIC.indtx>=BUFFER_SERIAL) setbit(MStatus, stop);    // Software decoding complete
             }
             if(testbit(MStatus, stop)) {
                 set_line(63,8,63,30);
@@ -326,6 +425,9 @@ void Sniff(void) {
             else {
                 lcd_goto(59,1); putchar3x6('R'); u8CursorX=65; putchar3x6('T');
             }
+            if(T.LOGIC.rawover) {           // TX or MISO samples lost
+                lcd_goto(65,2); putchar3x6('!');
+            }
             DisplayData(0,page); // Display RX or SDI data
             DisplayData(1,page); // Display TX or SDO data
         }
@@ -369,13 +471,256 @@ exitSniffer:
     clrbit(Misc,sacquired);
     USARTC0.CTRLA = 0x00;   // Disable receive interrupt
     USARTC0.CTRLB = 0x00;   // Disable UART RX
-    TCC1.INTCTRLA = 0x00;   // Disable timer interrupt
     TCC1.CTRLA = 0x00;      // Disable timer
+    TCC1.CTRLFSET = 0x0F;   // Reset timer, no capture
+    StopTCE0();
     PORTC.INTCTRL = 0x00;   // Disable PORTC interrupts
     SPIC.CTRL = 0x00;       // Disable SPI
+    setbit(DMA.CH1.CTRLA,6);    // reset DMA CH1, stop the samples
+    DMA.CH1.CTRLB = 0x10;       // Clear the transaction flag, no interrupts
+    EVSYS.CH2MUX = ch2mux;
     PR.PRPC  = 0x7C;        // Stop: TWI, USART0, USART1, SPI, HIRES
 }
 
+// Give TCE0 back, the frequency counter sets it up again
+static void StopTCE0(void) {
+    TCE0.CTRLA = 0x00;      // Stop timer prior to reset
+    TCE0.CTRLFSET = 0x0F;   // Reset timer, disable decoder interrupt
+    TCC0.CTRLD = 0;         // Frequency counter registers not set
+}
+
+// UART auto detection
+// The bit time is the average of the pulse widths, each divided by its number
+// of bits, with the shortest pulse as the first guess. The RX line is timed
+// first, TX if RX is idle. A line that idles low is inverted, on the pin, for
+// the rest of the detection and in the sniffer. Then the frame format is found by decoding a window
+// of samples with each format: longer frames first, since a longer wrong
+// frame runs into the next start bit, and parity before no parity at the same
+// length, since random data rarely keeps a parity. Two stop bits can't be told
+// from idle time, they are only chosen when most frames follow the previous
+// one without a gap.
+// A bit time more than 5% from the menu rates is kept in UARTCustom.
+// Returns 0 if no baud rate is found, 1 if only the baud rate is set, 2 if the
+// frame format is set too.
+uint8_t UARTAuto(void) {
+    uint16_t *width=(uint16_t *)T.LOGIC.raw;
+    uint16_t n=0, bit;
+    uint8_t ch2mux=EVSYS.CH2MUX, pin, idle=1, baud, format=Sniffer&0xF8;
+    for(pin=2; pin<=3; pin++) {             // BIT2:RX, BIT3:TX
+        idle=IdleLevel(pin);
+        n=Pulses(pin, width);
+        if(n>=8) break;
+    }
+    EVSYS.CH2MUX = ch2mux;
+    StopTCE0();
+    if(n<8) return 0;
+    UARTInvert=!idle;
+    if(UARTInvert) (&PORTC.PIN0CTRL)[pin] ^= PORT_INVEN_bm;  // For Samples, Apply restores the pin
+    bit=BitTime(width, n);
+    if(bit<AUTO_MINBIT) return 0;           // Faster than the decoder follows
+    baud=BaudIndex(bit);
+    UARTCustom=0;
+    if(baud==0xFF) {                        // Not in the menu, the menu rate is kept
+        UARTCustom=bit;
+        baud=Sniffer&0x07;
+    }
+    Sniffer=format|baud;
+    if(!Samples(pin)) return 1;
+    for(uint8_t bits=9; bits>=5; bits--) {      // Data and parity bits, longest frame first
+        for(uint8_t par=0; par<3; par++) {      // Even, odd, no parity
+            uint8_t databits=bits;
+            if(par<2) databits--;
+            if(databits<5 || databits>8) continue;
+            format=baud|((databits-5)<<3);
+            if(par<2) setbit(format,parmode);
+            if(par==1) setbit(format,parity);
+            if(FrameTest(format)) {
+                if(FrameTest(format|(1<<stopbit)) && T.LOGIC.rawerrors==0 &&
+                   T.LOGIC.rawnogap*2>=T.LOGIC.rawframes) setbit(format,stopbit);
+                Sniffer=format;
+                return 2;
+            }
+        }
+    }
+    Sniffer=(Sniffer&0xF8)|baud;    // FrameTest changed the format
+    return 1;
+}
+
+// Level of the longest time without an edge on a logic bit, in about 15ms:
+// the idle level, unless the line is busy without gaps. Returns 1 if high.
+static uint8_t IdleLevel(uint8_t pin) {
+    uint16_t i, run=0, maxhi=0, maxlo=0;
+    uint8_t level=VPORT2.IN&_BV(pin), now;
+    WDR();
+    for(i=0; i<50000; i++) {
+        now=VPORT2.IN&_BV(pin);
+        if(now!=level) {
+            level=now;
+            run=0;
+        }
+        run++;
+        if(level) { if(run>maxhi) maxhi=run; }
+        else if(run>maxlo) maxlo=run;
+    }
+    return maxhi>=maxlo;
+}
+
+// Time up to AUTO_PULSES pulses of a logic bit, for up to 1 second
+// TCE0 captures the edges on Event CH2, pulses that span a whole timer period are skipped
+static uint16_t Pulses(uint8_t pin, uint16_t *width) {
+    uint16_t n=0, last=0, cap, ovf=0;
+    uint8_t wraps=2;                // No previous edge
+    (&PORTC.PIN0CTRL)[pin] &= 0xF8;     // Sense both edges
+    EVSYS.CH2MUX = 0x60+pin;        // Event CH2 = PORTC pin
+    TCE0.CTRLA = 0;                 // Stop timer prior to reset
+    TCE0.CTRLFSET = 0x0F;           // Reset timer
+    TCE0.CTRLB = TC0_CCAEN_bm;      // Capture enable
+    TCE0.CTRLD = 0x2A;              // Input capture on event, no delay compensate, Event CH2
+    TCE0.CTRLA = 0x01;              // DIV1, 2.048ms period
+    while(n<AUTO_PULSES && ovf<488) {
+        WDR();
+        if(testbit(TCE0.INTFLAGS,0)) {  // Overflow
+            TCE0.INTFLAGS = 0x01;       // Clear overflow flag
+            ovf++;
+            if(wraps<2) wraps++;
+        }
+        if(testbit(TCE0.INTFLAGS,4)) {  // Capture
+            cap=TCE0.CCA;               // Clears the flag
+            if(wraps==0 || (wraps==1 && cap<last)) {
+                if((uint16_t)(cap-last)>=AUTO_MINPULSE) width[n++]=cap-last;
+            }
+            last=cap;
+            wraps=0;
+        }
+    }
+    return n;
+}
+
+// Bit time in CPU cycles from the pulse widths. The shortest pulse is halved
+// while more than 1 in 16 pulses are off its multiples by over a quarter of
+// it: they sit on odd half bits, no 1 bit pulse was timed. Traffic where all
+// the pulses are an even number of bits can't be told from a baud rate twice
+// slower, that rate is returned.
+static uint16_t BitTime(const uint16_t *width, uint16_t n) {
+    uint16_t bit=0xFFFF, i, off;
+    uint32_t sum=0, bits=0;
+    for(i=0; i<n; i++) if(width[i]<bit) bit=width[i];
+    for(;;) {
+        off=0;
+        for(i=0; i<n; i++) {
+            uint16_t r=width[i]%bit;        // From the nearest multiple
+            if(r>bit/2) r=bit-r;
+            if((width[i]+bit/2)/bit<=10 && r>bit/4) off++;
+        }
+        if(off*16<=n || bit<AUTO_MINBIT) break;
+        bit/=2;
+    }
+    for(i=0; i<n; i++) {
+        uint16_t k=(width[i]+bit/2)/bit;    // Bits in the pulse
+        if(k<=10) {
+            sum+=width[i];
+            bits+=k;
+        }
+    }
+    return sum/bits;
+}
+
+// Closest menu baud rate to a bit time, 0xFF if none is within 5%
+static uint8_t BaudIndex(uint16_t bit) {
+    for(uint8_t i=0; i<8; i++) {
+        uint16_t t=pgm_read_word_near(TCC1val+i)+1;
+        uint16_t d=(bit>t)? bit-t: t-bit;
+        if((uint32_t)d*20<t) return i;
+    }
+    return 0xFF;
+}
+
+// Fill the sample buffer with a logic bit at 4 times the baud rate, moved to
+// bit 3 where FrameTest reads TX. Returns 0 if the DMA didn't finish.
+static uint8_t Samples(uint8_t pin) {
+    uint16_t i;
+    TCC1.CTRLA = 0;
+    TCC1.CNT = 0;
+    TCC1.PER = BitPeriod()/4;           // Sample at 4 times the baud rate
+    setbit(DMA.CH1.CTRLA,6);            // reset DMA CH1
+    DMA.CH1.ADDRCTRL  = 0b10000101;     // reload source addr after each burst, incr dest, reload dest end block
+    DMA.CH1.TRFCNT    = BUFFER_RAW;     // buffer size
+    DMA.CH1.DESTADDR0 = (((uint16_t) T.LOGIC.raw)     ) & 0xFF;
+    DMA.CH1.DESTADDR1 = (((uint16_t) T.LOGIC.raw)>>1*8) & 0xFF;
+    DMA.CH1.TRIGSRC   = 0x46;           // TCC1 overflow
+    DMA.CH1.SRCADDR0  = (((uint16_t)(&PORTC.IN))     ) & 0xFF;
+    DMA.CH1.SRCADDR1  = (((uint16_t)(&PORTC.IN))>>1*8) & 0xFF;
+    DMA.CH1.CTRLA     = 0b10000100;     // no repeat, 1 byte burst
+    TCC1.CTRLA = 0x01;                  // DIV1
+    for(i=0; testbit(DMA.CH1.CTRLA,7); i++) {   // 320ms at 1200 baud
+        if(i>=100) break;
+        WDR();
+        delay_ms(10);
+    }
+    TCC1.CTRLA = 0;
+    if(testbit(DMA.CH1.CTRLA,7)) return 0;
+    if(pin==2) for(i=0; i<BUFFER_RAW; i++) T.LOGIC.raw[i]<<=1;    // RX to the TX bit
+    return 1;
+}
+
+// Bit time in CPU cycles minus one, of the detected rate or the menu rate
+static uint16_t BitPeriod(void) {
+    if(UARTCustom) return UARTCustom-1;
+    return pgm_read_word_near(TCC1val+(Sniffer&0x07));
+}
+
+// USARTC0 baud rate for a bit time in CPU cycles. The most negative BSCALE
+// that keeps BSEL in 12 bits: bit = 16*(BSEL/2^-BSCALE+1)
+static void USARTBaud(uint16_t bit) {
+    uint8_t k=7;
+    uint32_t bsel;
+    for(;;) {
+        bsel=(((uint32_t)bit<<k)+8)/16-(1<<k);
+        if(bsel<4096 || k==0) break;
+        k--;
+    }
+    USARTC0.BAUDCTRLA = bsel;
+    USARTC0.BAUDCTRLB = (uint8_t)(-k<<4)|(bsel>>8);
+}
+
+// Decode the sample buffer with a format in the Sniffer bits layout
+// Returns 1 if enough frames are decoded, with less than 1 error in 8 frames.
+// A last bit, parity or data, that is always high is the stop bit or the idle
+// line of a shorter frame, so the format is rejected.
+static uint8_t FrameTest(uint8_t format) {
+    uint8_t stopped=MStatus&(1<<stop), all=1, last;
+    uint16_t i;
+    Sniffer=format;
+    uint16_t per=BitPeriod()/4+1;   // Sample period of Samples
+    T.LOGIC.databits=((format&0x18)>>3)+5;
+    T.LOGIC.baud=BitPeriod();
+    T.LOGIC.rawtx=0;
+    T.LOGIC.rawbits=0;
+    T.LOGIC.rawwait=0;
+    T.LOGIC.rawframes=0;
+    T.LOGIC.rawerrors=0;
+    T.LOGIC.rawnogap=0;
+    T.LOGIC.rawlevel=testbit(T.LOGIC.raw[0],3)? 1: 0;
+    clrbit(MStatus, stop);          // Keep the decoded data
+    for(i=1; i<BUFFER_RAW; i++) {   // The edges of the samples, between two samples
+        if((testbit(T.LOGIC.raw[i],3)? 1: 0)!=T.LOGIC.rawlevel) UARTEdge((uint32_t)i*per-per/2);
+    }
+    UARTUntil((uint32_t)BUFFER_RAW*per);
+    MStatus|=stopped;
+    if(T.LOGIC.rawframes<8 || T.LOGIC.rawerrors*8>T.LOGIC.rawframes) return 0;
+    for(i=0; i<T.LOGIC.rawtx; i++) {
+        uint8_t data=T.LOGIC.data.Serial.TX[i];
+        if(testbit(format,parmode)) {   // Parity bit
+            last=0;
+            for(; data; data=data>>1) last^=data&0x01;
+            if(testbit(format,parity)) last^=1;
+        }
+        else last=data>>(T.LOGIC.databits-1);
+        all&=last;
+    }
+    return !all;
+}
+
 // Display SPI or UART data
 void DisplayData(uint8_t side, uint8_t page) {
     uint8_t Xoff, size;
@@ -537,101 +882,186 @@ exiti2cb:
     PORTC.INTFLAGS = 0x01;  // Clear rising edge interrupt
 }
 
-// Decode SPI protocol, SCK triggers this interrupt
-// Temp.LOGIC.addr_ack_pos holds data
+// End of an SPI frame, /SS triggers this interrupt
+// The sample taken now has /SS high, the MISO decoder starts a new byte
 ISR(PORTC_INT1_vect) {
-    uint8_t data, i=8;
-    TCC0.CNTL = 2;      // Max 81.92ms timeout
-    setbit(TCC0.INTFLAGS, TC2_LUNFIF_bp);    // Clear trigger timeout interrupt
+    setbit(DMA.CH1.CTRLA,4);    // Transfer request
+}
 
-    if(testbit(Sniffer,CPHA)) {    // CPHA == 1 - Sample on second edge
-        do {
-            // wait for clock rising
-            while(!testbit(VPORT2.IN, 7)) if(testbit(TCC0.INTFLAGS, TC2_LUNFIF_bp)) return;
-            data=data<<1;
-            // wait for clock falling
-            while(testbit(VPORT2.IN, 7)) if(testbit(TCC0.INTFLAGS, TC2_LUNFIF_bp)) return;
-            if(testbit(VPORT2.IN, 6)) data|=0x01; // Read MISO
-        } while(--i);
-
-    }
-    else {                  // CPHA == 0    - Sample on first edge
-        do {
-            // wait for clock rising
-            while(!testbit(VPORT2.IN, 7)) if(testbit(TCC0.INTFLAGS, TC2_LUNFIF_bp)) return;
-            data=data<<1;
-            if(testbit(VPORT2.IN, 6)) data|=0x01; // Read MISO
-            // wait for clock falling
-            while(testbit(VPORT2.IN, 7)) if(testbit(TCC0.INTFLAGS, TC2_LUNFIF_bp)) return;
-        } while(--i);
-    }
-    T.LOGIC.addr_ack_pos=data;      // data holder for DMA
-    PORTC.INTFLAGS = 0x02;      // Clear rising edge interrupt
-    // Save data on buffer
-    if(!testbit(MStatus, stop)) setbit(DMA.CH1.CTRLA,4);    // Transfer request
+// A lap of the sample ring
+ISR(DMA_CH1_vect) {
+    DMA.CH1.CTRLB = 0x13;       // Clear the transaction flag
+    T.LOGIC.rawlaps++;
 }
 
-// Bit banging to decode the TX pin:
-// The interrupt monitors the TX line at four times the baud rate,
-// when the start bit is sensed, the timer period is set to the baud rate
-// then all the incoming characters are processed inside the interrupt.
-// Before exiting, the timer is set to 4 times the baud rate again.
-ISR(TCC1_OVF_vect) {
-    uint8_t i, data=0, paritybit=0;
-
-    // Start Bit
-    if(testbit(VPORT2.IN, 3)) return;
-    TCC1.INTFLAGS = 0x01;   // Clear overflow flag
-    while(!testbit(TCC1.INTFLAGS,0));   // wait for next time slice
-    // Set actual baud rate
-    TCC1.PER = T.LOGIC.baud;
-
-    // Data bits
-    for(i=0; i<T.LOGIC.databits; i++) {
-        TCC1.INTFLAGS = 0x01;   // Clear overflow flag
-        while(!testbit(TCC1.INTFLAGS,0));   // wait for next time bit
-        data=data>>1;
-        if(testbit(VPORT2.IN, 3)) {
-            data|=0x80;
-            paritybit++;
-        }
+// Next byte to be written by the DMA. If the DMA wrote BUFFER_RAW bytes or
+// more since the last call, the samples not decoded are gone: sets rawover,
+// moves rawpos there and waits for the next frame. Called from the TCE0
+// interrupt, the laps are counted at high level.
+static uint16_t RawWrite(void) {
+    uint16_t a, b, w, r=T.LOGIC.rawpos;
+    uint8_t laps;
+    cli();
+    a=DMA.CH1.TRFCNT;
+    laps=T.LOGIC.rawlaps;
+    b=DMA.CH1.TRFCNT;
+    if(b>a || (DMA.CH1.CTRLB&0x10)) {   // A lap not counted yet
+        DMA.CH1.CTRLB = 0x13;
+        laps++;
+    }
+    T.LOGIC.rawlaps=0;
+    sei();
+    w=BUFFER_RAW-b;
+    if(w>=BUFFER_RAW) w=0;
+    if(M.CHDdecode!=spi) w&=~1;         // UART: the whole captures
+    if(laps>1 || (laps && w>=r)) {      // Lapped the read position
+        T.LOGIC.rawover=1;
+        T.LOGIC.rawpos=w;
+        T.LOGIC.rawbits=(M.CHDdecode==spi)? SPI_SYNC: 0;
+        T.LOGIC.rawwait=0;
     }
-    for(i=T.LOGIC.databits; i<8; i++) data=data>>1;
-    // Check Parity
-    if(testbit(Sniffer,parmode)) {
-        TCC1.INTFLAGS = 0x01;   // Clear overflow flag
-        while(!testbit(TCC1.INTFLAGS,0));   // wait for next time bit
-        if(testbit(Sniffer,parity)) {  // Odd Parity
-            if( (testbit(paritybit,0) && testbit(VPORT2.IN, 3)) ||
-                (!testbit(paritybit,0) && !testbit(VPORT2.IN, 3)))
-                goto exituart;   // Parity error
+    return w;
+}
+
+// Pack the MISO bits of the SCK samples, called from the TCE0 interrupt.
+// Bytes are discarded while stopped, until the next end of frame, and after
+// an overrun.
+static void DecodeMISO(void) {
+    uint16_t w=RawWrite();
+    uint16_t r=T.LOGIC.rawpos, tx=T.LOGIC.rawtx;
+    uint8_t data=T.LOGIC.addr_ack_pos, bits=T.LOGIC.rawbits, sample;
+    while(r!=w) {
+        sample=T.LOGIC.raw[r];
+        if(++r>=BUFFER_RAW) r=0;
+        if(testbit(sample,4)) {             // SS not asserted
+            bits=0;
+            continue;
         }
-        else {                  // Even Parity
-            if( (!testbit(paritybit,0) && testbit(VPORT2.IN, 3)) ||
-                (testbit(paritybit,0) && !testbit(VPORT2.IN, 3)))
-                goto exituart;   // Parity error
+        if(testbit(MStatus, stop)) bits=SPI_SYNC;
+        if(bits>=SPI_SYNC) continue;
+        data=data<<1;
+        if(testbit(sample,6)) data|=0x01;   // Read MISO
+        if(++bits<8) continue;
+        bits=0;
+        if(tx<BUFFER_SERIAL) {              // Save data on buffer
+            T.LOGIC.data.Serial.TX[tx++]=data;
+            if(tx>=BUFFER_SERIAL && !testbit(Mcursors, singlesniff)) tx=0;
         }
     }
+    T.LOGIC.rawpos=r;
+    T.LOGIC.rawtx=tx;
+    T.LOGIC.addr_ack_pos=data;
+    T.LOGIC.rawbits=bits;
+}
+
+// Decode the TX edges, called from the TCE0 interrupt. The 16 bit captures
+// are extended to CPU cycles from the time of the overflow, an edge captured
+// after it is left for the next call. A late call only delays the decoding.
+// When all edges are decoded, none came for a while and the level read is
+// not the decoded level, an edge was lost: the decoder takes the level read
+// and drops the frame.
+static void DecodeTX(void) {
+    const uint16_t *cap=(const uint16_t *)T.LOGIC.raw;
+    uint16_t now16=T.LOGIC.rawcnt, w, r;
+    uint32_t now=T.LOGIC.rawtime+32000, t;
+    uint8_t pin1, pin2;
+    pin1=testbit(VPORT2.IN,3)? 1: 0;
+    w=RawWrite();                       // Has the edges before pin1 was read
+    pin2=testbit(VPORT2.IN,3)? 1: 0;
+    T.LOGIC.rawtime=now;
+    T.LOGIC.rawcnt=now16+8000;
+    for(r=T.LOGIC.rawpos; r!=w; ) {
+        t=now+4*(int32_t)(int16_t)(cap[r/2]-now16);
+        if((int32_t)(t-now)>0) break;   // After the overflow
+        UARTEdge(t);
+        r+=2; if(r>=BUFFER_RAW) r=0;
+    }
+    T.LOGIC.rawpos=r;
+    UARTUntil(now);
+    if(r==w && pin1==pin2 && pin1!=T.LOGIC.rawlevel && now-T.LOGIC.rawedge>64) {
+        T.LOGIC.rawlevel=pin1;          // Lost edge
+        if(T.LOGIC.rawbits) T.LOGIC.rawerrors++;
+        T.LOGIC.rawbits=0;
+        T.LOGIC.rawwait=0;
+    }
+}
 
-    // First Stop bit
-    TCC1.INTFLAGS = 0x01;   // Clear overflow flag
-    while(!testbit(TCC1.INTFLAGS,0));   // wait for next time bit
-    if(!testbit(VPORT2.IN, 3))
-        goto exituart;       // stop bit error
+// A TX edge at time t in CPU cycles. The start bit begins on a falling edge
+// while idle, the first data bit is read 1.5 bits later, then every bit.
+// A start within a bit of the end of the last good frame counts in rawnogap.
+static void UARTEdge(uint32_t t) {
+    UARTUntil(t);
+    T.LOGIC.rawlevel^=1;
+    T.LOGIC.rawedge=t;
+    if(T.LOGIC.rawbits || T.LOGIC.rawlevel) return;
+    if(T.LOGIC.rawwait && (int32_t)(t-T.LOGIC.rawend)<=0) T.LOGIC.rawnogap++;
+    T.LOGIC.rawbits=1;
+    T.LOGIC.rawwait=0;
+    T.LOGIC.addr_ack_pos=0;
+    T.LOGIC.rawnext=t+(T.LOGIC.baud+1)+(T.LOGIC.baud+1)/2;
+}
 
-    // Second Stop bit
-    if(testbit(Sniffer,stopbit)) {
-        TCC1.INTFLAGS = 0x01;   // Clear overflow flag
-        while(!testbit(TCC1.INTFLAGS,0));   // wait for next time bit
-        if(!testbit(VPORT2.IN, 3))
-            goto exituart;  // stop bit error
+// Read the bits of the frame that are due before time t, the line holds
+// rawlevel until then.
+static void UARTUntil(uint32_t t) {
+    while(T.LOGIC.rawbits && (int32_t)(t-T.LOGIC.rawnext)>0) {
+        UARTBit();
+        T.LOGIC.rawnext+=T.LOGIC.baud+1;
     }
+}
 
-    T.LOGIC.addr_ack_pos=data;   // data holder for DMA
-    // Save data on buffer
-    if(!testbit(MStatus, stop)) setbit(DMA.CH1.CTRLA,4);    // Transfer request
+// The bit of the frame at rawnext is rawlevel. Counts the good frames and
+// the frames with errors.
+static void UARTBit(void) {
+    uint8_t data=T.LOGIC.addr_ack_pos, bits=T.LOGIC.rawbits;
+    uint8_t first=T.LOGIC.databits+1;           // First stop bit
+    uint8_t last;                               // Last stop bit
+    if(testbit(Sniffer,parmode)) first++;
+    last=first;
+    if(testbit(Sniffer,stopbit)) last++;
+    if(bits<=T.LOGIC.databits) {                // Data bits
+        data=data>>1;
+        if(T.LOGIC.rawlevel) data|=0x80;
+    }
+    else if(bits<first) {                       // Check Parity
+        uint8_t odd=T.LOGIC.rawlevel;
+        for(uint8_t b=data; b; b=b>>1) odd^=b&0x01;
+        if(testbit(Sniffer,parity)) odd^=1;     // Odd Parity
+        if(odd) {                               // Parity error
+            T.LOGIC.rawerrors++;
+            T.LOGIC.rawbits=0;
+            return;
+        }
+    }
+    else {                                      // Stop bits
+        if(!T.LOGIC.rawlevel) {                 // Stop bit error
+            T.LOGIC.rawerrors++;
+            T.LOGIC.rawbits=0;
+            return;
+        }
+        if(bits==last) {
+            uint16_t tx=T.LOGIC.rawtx;
+            for(uint8_t i=T.LOGIC.databits; i<8; i++) data=data>>1;
+            if(!testbit(MStatus, stop) && tx<BUFFER_SERIAL) {   // Save data on buffer
+                T.LOGIC.data.Serial.TX[tx++]=data;
+                if(tx>=BUFFER_SERIAL && !testbit(Mcursors, singlesniff)) tx=0;
+                T.LOGIC.rawtx=tx;
+            }
+            T.LOGIC.rawframes++;
+            T.LOGIC.rawbits=0;
+            T.LOGIC.rawwait=1;
+            T.LOGIC.rawend=T.LOGIC.rawnext+T.LOGIC.baud+1;
+            return;
+        }
+    }
+    T.LOGIC.addr_ack_pos=data;
+    T.LOGIC.rawbits=bits+1;
+}
 
-exituart:
-    TCC1.PER = T.LOGIC.baud/4;
-    TCC1.INTFLAGS = 0x01;   // Clear overflow flag
+// UART TX or SPI MISO decoder, every 1ms
+ISR(TCE0_OVF_vect) {
+    PROFILE_ON(PROFILE_DECODE);
+    if(M.CHDdecode==spi) DecodeMISO();
+    else DecodeTX();
+    PROFILE_OFF(PROFILE_DECODE);
 }
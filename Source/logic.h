@@ -3,5 +3,9 @@
 
 void HEXSerial(void);           // Display the HEX value of the digital stream
 void Sniff(void);             // Protocol Sniffer
+uint8_t UARTAuto(void);       // Detect the UART baud rate and frame format
+
+extern uint16_t UARTCustom;   // Bit time in CPU cycles of a detected baud rate not in the menu, 0 if none
+extern uint8_t UARTInvert;    // The detected lines idle low with the logic input setting, the sniffer inverts them
 
 #endif
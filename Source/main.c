@@ -7,7 +7,7 @@
               Also used as Frequency counter time keeper
               Watch: 100Hz Stopwatch timer
         TCC1  Counts post trigger samples
-              UART sniffer time base
+              UART sniffer: 4 times the baud rate, triggers DMA CH1
               Watch: 1 minute Stopwatch timer
         TCD0  Split timer, source is Event CH6 (1.024ms)
             TCD0L 40.96mS period - 24.4140625 Hz - Source for Event CH7
@@ -16,6 +16,7 @@
               Scope: Overflow used for AWG
         TCE0  Watch: Sounds frequencies
               Scope: Frequency counter low 16bits
+              Sniffer: UART TX or SPI MISO decoder, 1ms
         TCE1  Controls Interrupt ADC (srate >= 11), srate: 6, 7, 8, 9, 10
               Fixed value for slow sampling
               Frequency counter high 16bits
@@ -24,6 +25,7 @@
 	    CH0 TCE1 overflow used for ADC
 	    CH1 ADCA CH0 conversion complete
         CH2 Input pin for frequency measuring
+            SPI sniffer: SCK, triggers DMA CH1
         CH3 TCD1 overflow used for DAC
         CH4 RTC overflow -> every 1 sec. Used for Time and freq. measuring
         CH5 TCE0 overflow used for freq. measuring
@@ -32,7 +34,7 @@
         CH7 TCD0L underflow: 40.96mS period - 24.4140625 Hz
 	DMAs:
 	    CH0 ADC CH0  / SPI Sniffer MOSI / UART Sniffer
-	    CH1 ADC CH1  / SPI Sniffer MISO
+	    CH1 ADC CH1  / Sniffer UART TX or SPI MISO (PORTC samples)
 	    CH2 Port CHD / Display
 	    CH3 AWG DAC
     USART:
@@ -50,9 +52,9 @@
         3871    Total + plus some global variables
     Interrupt Levels:
         TCE1:           High        Slow Sampling
-        PORTC_INT1      High        SPI sniffer
+        PORTC_INT1      High        SPI sniffer end of frame
         PORTC INT0      High        I2C sniffer
-        TCC1            High        UART sniffer
+        TCE0            Low         UART TX or SPI MISO sniffer decoder
         USB BUSEVENT    Medium      USB Bus Event
         USB_TRNCOMPL    Medium      USB Transaction Complete
         PORTA INT0:     Medium      keys
@@ -60,6 +62,7 @@
         TCC0H:          Low         auto keys
         RTC:            Low         sleep timeout, menu timeout
         TCD0H:          Low         Watch mode Auto Repeat Key
+        TCD0L:          Low         AWG timed sweep
 */
 #include <avr/io.h>
 #include <util/delay.h>
@@ -76,6 +79,7 @@
 #include "utils.h"
 #include "config.h"
 #include "moon.h"
+#include "spectrum.h"
 
 FUSES = {
 	.FUSEBYTE0 = 0xFF,  // JTAG not used, ***NEEDS*** to be off
@@ -135,7 +139,7 @@ int main(void) {
     PORTB.OUT       = 0b10000000;   // Logic port as input, Analog power off
     //PORTC.DIR = 0b00000000;       // LOGIC, register initial value is 0
     PORTC.INT0MASK  = 0x01;         // PC0 (SDA) will be the interrupt 0 source
-    PORTC.INT1MASK  = 0x80;         // PC7 (SCK) will be the interrupt 1 source
+    PORTC.INT1MASK  = 0x10;         // PC4 (/SS) will be the interrupt 1 source
     PORTD.DIR       = 0b00111111;   // D+, D-, LCDVDD, EXTCOMM, LCDIN, LCDDISP, LCDCLK, LCDCS
     PORTD.OUT       = 0b00100000;   // Power to LCD
     PORTE.DIR       = 0b00111111;   // Crystal, crystal, buzzer, buzzer, BATTSENSEPOW, RED, GRN, WHT
@@ -207,6 +211,7 @@ int main(void) {
                         TCD0.CCAH = 128;                        // Automatic EXTCOMM with Timer D0, 3.814697265625 Hz
                         uint16_t tempCNTF = TCF0.CNT;           // Save timer F
                         MSO();                                  // go to MSO
+                        SweepRun(0);                            // Stop the timed sweep, EXT TRIG back to an input
                         USB.CTRLB = 0;                          // USB Disattach
                         USB.ADDR = 0;
                         USB.CTRLA = 0;
@@ -366,7 +371,12 @@ ISR(TCC2_HUNF_vect) {
 }
 
 // Set auto repeat key flag - Watch mode
+// Scope mode: TCD0 is split, the vector is the TCD0L underflow: AWG timed sweep
 ISR(TCD0_OVF_vect) {
+    if(TCD0.CTRLE) {           // Split mode
+        SweepTick();
+        return;
+    }
     TCD0.CTRLA = 0;            // Stop timer
     TCD0.INTCTRLA = 0;         // Disable Auto Key interrupt
     PR.PRPD |= 0b00000001;     // Disable TCD0 clock
@@ -507,6 +517,7 @@ void CalibrateOffset(void) {
         int16_t avrg1, avrg2;
         clr_display();
         TCF0.INTCTRLB = 0x00;               // Disable 1 minute interrupt to prevent writing GPIO0
+        FFTSize=FFT_256; FFTZoom=0;         // Capture both channels
 	    for(Srate=0; Srate<8; Srate++) {	// Cycle thru first 8 SamplingRates
             i=6; do {                       // Cycle thru all the gains
                 int8_t  *q1, *q2;  // temp pointers to signed 8 bits
@@ -2,6 +2,7 @@
 #define _MAIN_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <avr/eeprom.h>
 #include <avr/pgmspace.h>
 #include "hardware.h"
@@ -240,7 +241,33 @@ typedef union {
             struct {
                 complex_t   bfly[FFT_N];	// FFT buffer: (re16,im16)*256 = 1024 bytes
                 uint8_t     magn[FFT_N];	// Magnitude output: 128 bytes, IQ: 256 bytes
+                uint16_t    acc[FFT_N];         // Average or max hold, past the capture in TempCH1
             } FFT;
+            struct {
+                int8_t      skip[2048];         // TempCH1, the capture
+                complex_t   bfly[FFT_N*2];      // 512 and 1024 point FFT buffer, all of TempCH2
+                uint8_t     skip2[1536];        // Logic capture, Mask, Reference
+                uint8_t     magn[FFT_N/2];      // Magnitude output
+                uint16_t    acc[FFT_N/2];       // Average or max hold
+            } FFTD;
+            struct {
+                uint8_t     skip[4608];         // TempCH1, TempCH2 and first 512 bytes of TempCHD
+                uint8_t     upper[256];         // Mask upper limit
+                uint8_t     lower[256];         // Mask lower limit
+            } MASK;
+            struct {
+                uint8_t     skip[5120];         // Captures, Mask
+                uint8_t     ch1[256];           // Cached reference CH1
+                uint8_t     ch2[256];           // Cached reference CH2
+                uint8_t     skip2[2048*3+4+BODE_POINTS*4+1-5632];   // FFT output, Meter, Bode results
+                uint8_t     pool[REF_POOL];     // EEPROM image, only used while loading or saving
+            } REF;
+            struct {
+                uint8_t     skip[512];          // TempCH1, used by the capture
+                uint8_t     hits1[1536];        // XY persistence, display lines 0 to 95
+                uint8_t     skip2[3584];        // TempCH2, TempCHD capture, Mask, Reference
+                uint8_t     hits2[512];         // XY persistence, display lines 96 to 127
+            } XY;
             struct {
                 int8_t      TempCH1[2048];		// CH1 Temp data
                 int8_t      TempCH2[2048];		// CH2 Temp data
@@ -251,6 +278,12 @@ typedef union {
                     uint32_t MeterFreq;
                 };
             };
+            struct {
+                int8_t      skip[2048*3+4];     // Captures, FFT, Mask, Reference and Meter, kept for the USB readout
+                int16_t     gain[BODE_POINTS];  // Gain, dB*10
+                int16_t     phase[BODE_POINTS]; // Phase, degrees*10
+                uint8_t     points;             // Valid points
+            } BODE;
         };
         uint8_t  adjusting;                 // Auto setup adjusting step
         uint16_t slowval;                   // Slow sampling rate time value
@@ -259,9 +292,9 @@ typedef union {
         ACHANNEL CH1,CH2;                   // Analog Channel 1, Channel 2
         DATA DC;                            // Data samples
     } SCOPE;
-    struct {
+    union {
         int8_t AWGTemp1[BUFFER_AWG];
-        int8_t AWGTemp2[BUFFER_AWG];
+        int16_t HarmSum[BUFFER_AWG];        // Harmonic synthesis, scaled in place into AWGTemp1
     } AWGDATA;
     struct {
         union {
@@ -284,6 +317,22 @@ typedef union {
         uint8_t *data_ptr;
         uint8_t addr_ack_pos;       // counter for keeping track of all bits / location for DMA
         uint16_t baud;              // Baud rate
+        uint16_t rawtx;             // TX or MISO bytes decoded, written by the TCE0 interrupt
+        uint16_t rawpos;            // Next sample to decode
+        uint8_t rawbits;            // UART: frame bit, 0 waits for a start bit. SPI: MISO bits, SPI_SYNC waits for the end of a frame
+        uint8_t rawwait;            // UART: the last frame ended without an error, for rawnogap
+        uint8_t rawlevel;           // UART: TX level after the last edge
+        uint16_t rawcnt;            // UART: TCC1 count at the next TCE0 overflow
+        uint32_t rawtime;           // UART: time of the last TCE0 overflow, CPU cycles
+        uint32_t rawedge;           // UART: time of the last edge
+        uint32_t rawnext;           // UART: center of the next bit of the frame
+        uint32_t rawend;            // UART: a start bit up to this time follows the last frame without a gap
+        uint16_t rawframes;         // UART: frames decoded
+        uint16_t rawerrors;         // UART: frames with parity or stop bit errors
+        uint16_t rawnogap;          // UART: frames that start right after the previous one
+        volatile uint8_t rawlaps;   // Times the DMA wrapped around raw, counted by the DMA CH1 interrupt
+        uint8_t rawover;            // The DMA overwrote samples not decoded yet
+        uint8_t raw[BUFFER_RAW];    // UART: TCC1 captures of the TX edges, 16 bits each, or the auto detection samples. SPI: PORTC on each SCK sampling edge, MISO is bit 6
     } LOGIC;
     struct {
         uint8_t oldHour, oldMinute, oldSecond, oldBattery;
@@ -330,6 +379,14 @@ typedef union {
     structQIX QIX;
 } TempData;
 
+// The sniffer data share T with the scope, the mask limits must stay valid
+// while a sniffer runs
+_Static_assert(offsetof(TempData, LOGIC.raw)+BUFFER_RAW <= offsetof(TempData, SCOPE.MASK.upper),
+               "LOGIC.raw overlaps the mask limits");
+// The reference pool is written while a capture may be running
+_Static_assert(offsetof(TempData, SCOPE.REF.pool) > offsetof(TempData, SCOPE.BODE.points),
+               "The reference pool overlaps the captures or the Bode results");
+
 // Variables that need to be stored in NVM
 
 enum protocols { spi, i2c, rs232, irda, onewire, midi };
@@ -0,0 +1,117 @@
+// Mask / limit testing
+// The golden CH1 trace is stored in EEPROM, the envelope is rebuilt in RAM
+// from the golden trace and the tolerance, then every new acquisition is
+// compared against it in a single pass.
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "main.h"
+#include "utils.h"
+#include "mask.h"
+
+uint8_t MaskCtrl;                   // Mask test options
+uint8_t MaskTol;                    // Mask tolerance, in samples
+static uint16_t MaskPass, MaskFail; // Counters
+static uint8_t  MaskBad;            // Samples outside the envelope on the last failure
+static uint8_t  MaskFrame;          // Last frame tested
+static uint8_t  beeping;            // Sound() borrowed the AWG timer
+
+static void printU16(uint16_t n);
+
+// Use the current CH1 trace as the golden trace
+void MaskNew(void) {
+    eeprom_write_block(T.SCOPE.DC.CH1data, EEMASK, 256);
+    eeprom_write_byte(&EEMaskTol, MaskTol);
+    MaskLoad();
+}
+
+// Build the envelope: max and min of each sample and its neighbors (+-1 sample
+// of trigger jitter), plus and minus the tolerance
+void MaskLoad(void) {
+    uint8_t i=0, g0, g1, g2, hi, lo;
+    g1=g0=eeprom_read_byte(&EEMASK[0]);
+    do {
+        if(i<255) g2=eeprom_read_byte(&EEMASK[i+1]);
+        else g2=g1;
+        hi=lo=g1;
+        if(g0>hi) hi=g0;
+        if(g2>hi) hi=g2;
+        if(g0<lo) lo=g0;
+        if(g2<lo) lo=g2;
+        T.SCOPE.MASK.upper[i]=addwsat(hi,MaskTol);
+        T.SCOPE.MASK.lower[i]=addwsat(lo,-MaskTol);
+        g0=g1; g1=g2;
+    } while(++i);
+    MaskReset();
+}
+
+void MaskReset(void) {
+    MaskPass=0; MaskFail=0; MaskBad=0;
+    MaskFrame=T.SCOPE.DC.frame;
+}
+
+// Compare a new acquisition against the envelope
+void MaskTest(void) {
+    uint8_t *p, *u, *l, bad=0, i=0;
+    if(beeping && TCD1.INTCTRLA==0) {   // Beep finished, give the timer back to the AWG
+        beeping=0;
+        PR.PRPD &= 0b11111101;          // Enable TCD1 clock
+        setbit(MStatus, updateawg);
+    }
+    if(T.SCOPE.DC.frame==MaskFrame) return;     // Already tested
+    MaskFrame=T.SCOPE.DC.frame;
+    p=T.SCOPE.DC.CH1data;
+    u=T.SCOPE.MASK.upper;
+    l=T.SCOPE.MASK.lower;
+    do {
+        uint8_t d=*p++;
+        if(d>*u++ || d<*l++) {
+            if(bad<255) bad++;
+        }
+    } while(++i);
+    if(bad) {
+        MaskBad=bad;
+        if(MaskFail<65535) MaskFail++;
+        if(testbit(MaskCtrl,masksound) && !beeping) {
+            beeping=1;
+            Sound(TuneBeep);
+        }
+        if(testbit(MaskCtrl,maskstop)) {
+            setbit(MStatus, stop);
+            setbit(MStatus, update);
+        }
+    }
+    else if(MaskPass<65535) MaskPass++;
+}
+
+// Show the envelope and the counters
+void MaskDraw(void) {
+    uint8_t i=0, j=0, x;
+    // The fast sampling rates only show 128 samples, starting at M.HPos
+    if(Srate<11) j=M.HPos;
+    do {
+        x=i;
+        if(Srate>=11) x=x>>1;
+        if(!(x&0x01)) {     // Dotted line
+            set_pixel(x, addwsat(T.SCOPE.MASK.upper[j],M.CH1pos)>>1);
+            set_pixel(x, addwsat(T.SCOPE.MASK.lower[j],M.CH1pos)>>1);
+        }
+        if(Srate<11 && i>=127) break;
+        j++;
+    } while(++i);
+    lcd_goto(56,0);
+    putchar3x6('P'); printU16(MaskPass);
+    putchar3x6(' '); putchar3x6('F'); printU16(MaskFail);
+    if(MaskFail) { putchar3x6('/'); printN3x6(MaskBad); }
+}
+
+// Print unsigned number, no leading zeros
+static void printU16(uint16_t n) {
+    uint8_t i=4, d, lead=1;
+    do {
+        uint16_t power=pgm_read_dword_near(Powersof10+i);
+        d='0';
+        while(n>=power) { d++; n-=power; }
+        if(d!='0' || i==0) lead=0;
+        if(!lead) putchar3x6(d);
+    } while(i--);
+}
@@ -0,0 +1,23 @@
+#ifndef _MASK_H
+#define _MASK_H
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+
+// MaskCtrl bits
+#define masktest    0       // Mask test running
+#define maskstop    1       // Stop on failure
+#define masksound   2       // Beep on failure
+
+extern uint8_t MaskCtrl;            // Mask test options
+extern uint8_t MaskTol;             // Mask tolerance, in samples
+extern uint8_t EEMEM EEMASK[256];   // Mask golden waveform CH1
+extern uint8_t EEMEM EEMaskTol;     // Mask tolerance
+
+void MaskNew(void);         // Use the current CH1 trace as the golden trace
+void MaskLoad(void);        // Build the envelope from the golden trace
+void MaskReset(void);       // Clear the counters
+void MaskTest(void);        // Compare a new acquisition against the envelope
+void MaskDraw(void);        // Show the envelope and the counters
+
+#endif
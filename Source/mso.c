@@ -9,6 +9,11 @@
 #include "USB\usb_xmega.h"
 #include "utils.h"
 #include "config.h"
+#include "bode.h"
+#include "mask.h"
+#include "ref.h"
+#include "spectrum.h"
+#include "xy.h"
 
 static uint16_t slow_count;
 static uint32_t slow_sum1, slow_sum2;
@@ -17,7 +22,8 @@ static uint32_t slow_sum1, slow_sum2;
 static void Reduce(void);
 static void RestorefromMeter(void);		        // Restores srate and gains
 static void GoingtoMeter(void);			        // Saves srate and gains
-static uint8_t fft_stuff(uint8_t *p);
+static void fft_stuff(void);
+static uint8_t fft_peak(const uint8_t *m);
 static void AutoCursorV(void);                     // Automatically set vertical the cursors
 static inline void Measurements(void);      // Measurements for Meter Mode
 static inline void ShowCursorV(void);       // Display Vertical Cursor
@@ -25,11 +31,12 @@ static inline void ShowCursorH(void);       // Display Horizontal Cursor
 static void CheckMax(void);                        // Check variables
 static inline void LoadEE(void);            // Load settings from EEPROM
 
-uint8_t EEMEM EECHREF1[256] = {0};  // Reference waveform CH1
-uint8_t EEMEM EECHREF2[256] = {0};  // Reference waveform CH2
-int8_t  EEMEM EECH1Pos = 0;         // Position for EE CH1
-int8_t  EEMEM EECH2Pos = 0;         // Position for EE CH2
-uint8_t EEMEM EEHPos = 0;           // Position for EE in XY mode
+uint8_t EEMEM EEREF[REF_POOL] = {REF_LAYOUT};  // Reference waveforms, compressed
+uint8_t EEMEM EERefSlot = 0;        // Active reference slot
+uint8_t EEMEM EEMASK[256] = {0};    // Mask golden waveform CH1
+uint8_t EEMEM EEMaskTol = 8;        // Mask tolerance
+
+static uint8_t UARTFound=2;         // Last UART auto detection, UARTAuto result, shown until a key in the menu
 
 // ADC system clock timers
 
@@ -130,6 +137,23 @@ const char menustxt[][35] PROGMEM = {           // Menus:
     "SW FREQ    \0  SW AMP   \0  SW DUTY ",     // 35 AWG Menu 6
     "  DOWN    \0  PINGPONG   \0  ACCEL\0",     // 36 Sweep Mode Menu, Leave last character space for icon
     " SUBTRACT \0  MULTIPLY  \0 DIFFRNTL ",     // 37 Operators
+    " BODE     \0     MASK   \0    THD   ",     // 38 Menu Select 6 - Tools
+    " NEW MASK \0  TOLERANCE  \0    TEST ",     // 39 Mask test
+    " STOP FAIL \0    SOUND   \0   RESET ",     // 40 Mask test options
+    " SAVE REF \0    SLOT    \0   REF-CH ",     // 41 Reference waveforms
+    " 256 PT   \0   512 PT   \0  1024 PT ",     // 42 FFT size
+    " AVERAGE  \0  MAX HOLD  \0  RESTART ",     // 43 FFT averaging
+    " DTMF     \0    50 HZ   \0   60 HZ  ",     // 44 Tone detector
+    " FLAT TOP \0   KAISER   \0    RECT  ",     // 45 More windows
+    " TRACE    \0  WATERFALL \0   CLEAR  ",     // 46 Spectrum display
+    " PEAK     \0  NEXT PEAK \0   DELTA  ",     // 47 Spectrum markers
+    " PERSIST  \0   PHASE    \0  Z BLANK ",     // 48 XY options
+    " BUFFER   \0     DDS    \0   BURST  ",     // 49 AWG engine
+    " AM       \0     FM     \0     PWM  ",     // 50 AWG modulation
+    " CONTINUE \0    BURST   \0  TRIGGER ",     // 51 AWG burst
+    " LOG      \0    LIST    \0 TRIG OUT ",     // 52 Sweep type, the marker drives EXT TRIG
+    " HARMONIC \0  AMPLITUDE \0   PHASE  ",     // 53 Harmonic synthesis
+    " WHITE    \0    PINK    \0   BAND   ",     // 54 Noise generator
 };
 
 const char menupoint[] PROGMEM = {  // Menu text table
@@ -177,6 +201,23 @@ const char menupoint[] PROGMEM = {  // Menu text table
     37, // MCH2OPER Math Operators
     30, // MAWG3 AWG Menu 3
     36, // MSWMODE Sweep Mode Menu
+    38, // MMAIN6 Menu Select 6 - Tools
+    39, // MMASK1 Mask test
+    40, // MMASK2 Mask test options
+    41, // MREF Reference waveforms
+    42, // MFFTSIZE FFT size
+    43, // MFFTAVG FFT averaging
+    44, // MTONES Tone detector
+    45, // MWINDOW2 More windows
+    46, // MFFTVIEW Spectrum display
+    47, // MMARKER Spectrum markers
+    48, // MXY XY options
+    49, // MAWG7 AWG engine
+    50, // MAWG8 AWG modulation
+    51, // MAWG9 AWG burst
+    52, // MSWTYPE Sweep type
+    53, // MHARM Harmonic synthesis
+    54, // MNOISE Noise generator
 };
 
 const char Next[] PROGMEM = {  // Next Menu
@@ -188,7 +229,7 @@ const char Next[] PROGMEM = {  // Next Menu
     Mdefault,   // MSNIFFER Sniffer mode
     MMAIN2,     // MTRIGTYPE Trigger Type
     MCURSOR2,   // MCURSOR1 Cursor
-    MMAIN4,     // MWINDOW Spectrum Analyzer Window
+    MWINDOW2,   // MWINDOW Spectrum Analyzer Window
     MMAIN2,     // MSOURCE Trigger Source
     Mdefault,   // MDISPLAY1 Display
     MMAIN3,     // MMETER Meter mode
@@ -199,16 +240,16 @@ const char Next[] PROGMEM = {  // Next Menu
     MMAIN2,     // MMAIN1 Menu Select 1 - Channel
     MMAIN3,     // MMAIN2 Menu Select 2 - Trigger
     MMAIN5,     // MMAIN3 Menu Select 3 - Mode
-    MMAIN3,     // MMAIN4 Menu Select 4 - FFT
-    Mdefault,   // MMAIN5 Menu Select 5 - Misc
+    MFFTSIZE,   // MMAIN4 Menu Select 4 - FFT
+    MMAIN6,     // MMAIN5 Menu Select 5 - Misc
     MAWG3,      // MAWG2 AWG Menu 2
-    MAWG2,      // MAWG4 AWG Menu 4
+    MHARM,      // MAWG4 AWG Menu 4
     Mdefault,   // MAWG5 AWG Menu 5
     MAWG5,      // MAWG6 AWG Menu 6
-    MMAIN3,     // MSCOPEOPT Scope options
+    MXY,        // MSCOPEOPT Scope options
     Mdefault,   // MTRIG2 Trigger Menu 2
     MTRIG2,     // MTRIGMODE Trigger edge and mode
-    Mdefault,   // MCURSOR2 More Cursor Options
+    MREF,       // MCURSOR2 More Cursor Options
     MCHDSEL2,   // MCHDSEL1 Logic Channel Select
     MCHDSEL3,   // MCHDSEL2 Logic Channel Select
     Mdefault,   // MCHDSEL3 Logic Channel Select
@@ -224,8 +265,25 @@ const char Next[] PROGMEM = {  // Next Menu
     Mdefault,   // MCH2MATH Channel 2 math
     Mdefault,   // MCH1OPER Math Operator
     Mdefault,   // MCH2OPER Math Operator
-    Mdefault,   // MAWG3 AWG Menu 3
-    MAWG5,      // MSWMODE Sweep mode menu
+    MAWG7,      // MAWG3 AWG Menu 3
+    MSWTYPE,    // MSWMODE Sweep mode menu
+    MTONES,     // MMAIN6 Menu Select 6 - Tools
+    MMASK2,     // MMASK1 Mask test
+    Mdefault,   // MMASK2 Mask test options
+    Mdefault,   // MREF Reference waveforms
+    MFFTAVG,    // MFFTSIZE FFT size
+    MFFTVIEW,   // MFFTAVG FFT averaging
+    Mdefault,   // MTONES Tone detector
+    MMAIN4,     // MWINDOW2 More windows
+    MMARKER,    // MFFTVIEW Spectrum display
+    MFFTZOOM,   // MMARKER Spectrum markers
+    MMAIN3,     // MXY XY options
+    MAWG8,      // MAWG7 AWG engine
+    MAWG9,      // MAWG8 AWG modulation
+    Mdefault,   // MAWG9 AWG burst
+    MAWG5,      // MSWTYPE Sweep type
+    MAWG2,      // MHARM Harmonic synthesis
+    MAWG4,      // MNOISE Noise generator
     MSNIFFER,   // MUART UART Settings
     MTRIG2,     // MPOSTT Post Trigger
     MAWG2,      // MAWGFREQ Frequency
@@ -235,6 +293,15 @@ const char Next[] PROGMEM = {  // Next Menu
     MAWG5,      // MSW1 Sweep Start
     MAWG5,      // MSW2 Sweep End
     MMAIN1,     // MHPOS Run/Stop - Horizontal Scroll
+    MMASK1,     // MMASKTOL Mask tolerance
+    MREF,       // MREFSLOT Reference slot
+    MFFTAVG,    // MFFTAVGN Frames averaged
+    MMAIN3,     // MFFTZOOM FFT zoom
+    MMODDEPTH,  // MMODRATE Modulation rate
+    MAWG8,      // MMODDEPTH Modulation depth
+    MAWG9,      // MBURST Burst cycles
+    MHARM,      // MHARMAMP Harmonic amplitude
+    MHARM,      // MHARMPH Harmonic phase
     MAWG5,      // MSWSPEED Sweep Speed
     MAWG3,      // MAWGAMP Amplitude
     MAWG3,      // MAWGOFF Offset
@@ -252,7 +319,7 @@ const char Next[] PROGMEM = {  // Next Menu
 
 const char Prev[] PROGMEM = {  // Previous Menu
 //  Next:          Current:
-    MMAIN5,     // Mdefault default
+    MTONES,     // Mdefault default
     MMAIN1,     // MCH1 Channel 1
     MMAIN1,     // MCH2 Channel 2
     MMAIN1,     // MCHD Logic
@@ -297,6 +364,23 @@ const char Prev[] PROGMEM = {  // Previous Menu
     MCH2MATH,   // MCH2OPER Math Operator
     MAWG2,      // MAWG3 AWG Menu 3
     MAWG5,      // MSWMODE Sweep mode menu
+    MMAIN5,     // MMAIN6 Menu Select 6 - Tools
+    MMAIN6,     // MMASK1 Mask test
+    MMASK1,     // MMASK2 Mask test options
+    MCURSOR2,   // MREF Reference waveforms
+    MMAIN4,     // MFFTSIZE FFT size
+    MFFTSIZE,   // MFFTAVG FFT averaging
+    MMAIN6,     // MTONES Tone detector
+    MWINDOW,    // MWINDOW2 More windows
+    MFFTAVG,    // MFFTVIEW Spectrum display
+    MFFTVIEW,   // MMARKER Spectrum markers
+    MSCOPEOPT,  // MXY XY options
+    MAWG3,      // MAWG7 AWG engine
+    MAWG7,      // MAWG8 AWG modulation
+    MAWG8,      // MAWG9 AWG burst
+    MSWMODE,    // MSWTYPE Sweep type
+    MAWG4,      // MHARM Harmonic synthesis
+    MAWG4,      // MNOISE Noise generator
     MPROTOCOL,  // MUART UART Settings
     MTRIG2,     // MPOSTT Post Trigger
     MAWG2,      // MAWGFREQ Frequency
@@ -306,6 +390,15 @@ const char Prev[] PROGMEM = {  // Previous Menu
     MAWG5,      // MSW1 Sweep Start
     MAWG5,      // MSW2 Sweep End
     MMAIN5,     // MHPOS Run/Stop - Horizontal Scroll
+    MMASK1,     // MMASKTOL Mask tolerance
+    MREF,       // MREFSLOT Reference slot
+    MFFTAVG,    // MFFTAVGN Frames averaged
+    MMARKER,    // MFFTZOOM FFT zoom
+    MAWG8,      // MMODRATE Modulation rate
+    MMODRATE,   // MMODDEPTH Modulation depth
+    MAWG9,      // MBURST Burst cycles
+    MHARM,      // MHARMAMP Harmonic amplitude
+    MHARM,      // MHARMPH Harmonic phase
     MAWG5,      // MSWSPEED Sweep Speed
     MAWG3,      // MAWGAMP Amplitude
     MAWG3,      // MAWGOFF Offset
@@ -402,9 +495,12 @@ void MSO(void) {
     uint16_t Tpost;
     int16_t AWGsweepi;          // AWG sweep counter
     uint8_t AWGspeed;           // AWG sweep increment
+    uint8_t harmonic=0;         // Harmonic being edited, 0 is the fundamental
     uint8_t chdtrigpos;         // Digital channel trigger position
 
     LoadEE();                   // Load settings
+    if(testbit(MaskCtrl, masktest)) MaskLoad();     // Envelope may have been overwritten
+    if(testbit(Mcursors, reference)) RefLoad(RefSlot);  // Reference cache too
     
     // Event System
     EVSYS.CH0MUX    = 0xE8;     // Event CH0 = TCE1 overflow used for ADC
@@ -425,17 +521,7 @@ void MSO(void) {
     //DACB.CH0OFFSETCAL = eeprom_read_byte(&EEDACoffset);  // Load DAC offset calibration
     DACB.CTRLA = 0x09;          // Enable DACB and CH1
 
-    // DMA for DAC
-    DMA.CH3.ADDRCTRL  = 0xD0;   // Reload after transaction, Increment source
-    DMA.CH3.TRIGSRC   = 0x26;   // Trigger source is DACB CH1
-    DMA.CH3.TRFCNT    = BUFFER_AWG;   // AWG Buffer size
-	DMA.CH3.SRCADDR0  = (((uint16_t) AWGBuffer)>>0*8) & 0xFF;
-	DMA.CH3.SRCADDR1  = (((uint16_t) AWGBuffer)>>1*8) & 0xFF;
-//	DMA.CH3.SRCADDR2  = 0;
-	DMA.CH3.DESTADDR0 = (((uint16_t)(&DACB.CH1DATAH))>>0*8) & 0xFF;
-	DMA.CH3.DESTADDR1 = (((uint16_t)(&DACB.CH1DATAH))>>1*8) & 0xFF;
-//	DMA.CH3.DESTADDR2 = 0;
-    DMA.CH3.CTRLA     = 0b10100100;     // Enable CH3, repeat mode, 1 byte burst, single
+    AWGDMAInit();               // DMA for DAC
     DMA.CTRL          = 0x80;           // Enable DMA, single buffer, round robin
 
     T.SCOPE.old_s=Srate;
@@ -451,6 +537,7 @@ void MSO(void) {
 
     for(;;) {
 		if(testbit(MStatus, updatemso)) Apply();
+        WaterfallCheck();
         if(testbit(MStatus, gosniffer)) {
             Buttons=0;  // Clear key before entering Sniffer
             clrbit(MStatus, stop);
@@ -459,7 +546,14 @@ void MSO(void) {
             Apply();    // Recover settings, particularly PORTC.PIN7CTRL
         }
         if(testbit(Misc,keyrep)) {  // Repeat key or long press
-            if(testbit(Buttons,K1) && testbit(MStatus,stop)) AutoSet();     // Long press KA -> Autoset
+            if(testbit(Buttons,K1) && Menu==MUART) {    // Long press KA in the UART menu -> Auto detect
+                TCE1.INTCTRLA = 0;          // Stop slow sampling, the detection uses the capture buffers
+                UARTFound=UARTAuto();
+                clrbit(Misc,keyrep);        // Once per press
+                setbit(MStatus, update);
+                setbit(MStatus, updatemso); // Recover settings, particularly TCC1, DMA CH1 and PORTC
+            }
+            else if(testbit(Buttons,K1) && testbit(MStatus,stop)) AutoSet();     // Long press KA -> Autoset
             if (testbit(Buttons,KUR) || testbit(Buttons,KUL)) {            // Waveform navigation
                 setbit(Misc, userinput);
             }
@@ -467,6 +561,7 @@ void MSO(void) {
                 setbit(Misc, userinput);
             }
             if (testbit(Buttons,KML)) {
+                WaterfallStop();
                 return;                    // Exit MSO
             }
         }
@@ -560,9 +655,10 @@ void MSO(void) {
 // Finish acquiring data, not in Pulse Counter mode
         if(testbit(MStatus, triggered) && !(MFFT<0x20 && testbit(MStatus,vdc) &&  testbit(MStatus,vp_p))) {
             if(Srate<11) {
-                int8_t   *q1, *q2, *q3;     // temp pointers to signed 8 bits
+                int8_t   *q1, *q2, *ch2buf; // temp pointers to signed 8 bits
                 uint8_t  *p1, *p2, *p3;     // temp pointers to unsigned 8 bits                
-                uint16_t circular;          // Index of circular buffer                
+                uint16_t circular, logic;   // Index of circular buffer, index of the logic buffer
+                uint8_t  deep=(FFTRawLength>512), blank2=0;    // Deep FFT capture, CH2 trace not captured
                 // Stop DMA trigger sources if in FREE mode
                 _delay_us(500);             // 10ms/div may need time to complete one more sample
                 TCE1.CTRLA = 0;
@@ -577,29 +673,39 @@ void MSO(void) {
                 if(testbit(CHDctrl,digchon)) clrbit(DMA.CH2.CTRLA, 7);
                 clrbit(DMA.CH0.CTRLA, 7);
                 clrbit(DMA.CH1.CTRLA, 7);
-                circular=512-DMA.CH0.TRFCNT;   // get index
+                circular=FFTRawLength-DMA.CH0.TRFCNT;   // get index
+                FFTCircular=circular;
+                logic=circular;
+                ch2buf=(int8_t *)T.SCOPE.TempCH2;
+                if(deep) {  // 512, 1024 point or zoom FFT: one channel in TempCH1, logic in its own 512 samples
+                    logic=512-DMA.CH2.TRFCNT;
+                    if(testbit(CH1ctrl,chon)) blank2=1;         // CH2 not captured, TempCH2 is the FFT buffer
+                    else ch2buf=(int8_t *)T.SCOPE.TempCH1;      // CH2 was captured in TempCH1
+                }
 ///////////////////////////////////////////////////////////////////////////////
 // Invert and adjust offset, apply channel math, loop thru circular buffer
-                if(Srate==0) {  // srate 0 only use the top half of the buffer
-                    circular+=256;
-                    if(circular>=512) circular=circular-512;
+                // The trace is the last 512 samples, srate 0 only uses the last 256
+                if(Srate==0) {
+                    circular+=FFTRawLength-256;
+                    logic+=512-256;
                 }
+                else circular+=FFTRawLength-512;
+                if(circular>=FFTRawLength) circular=circular-FFTRawLength;
+                logic&=511;
                 p1=T.SCOPE.DC.CH1data; p2=T.SCOPE.DC.CH2data; p3=T.SCOPE.DC.CHDdata;
                 q1=(int8_t *)T.SCOPE.TempCH1+circular;
-                q2=(int8_t *)T.SCOPE.TempCH2+circular;
-                q3=(int8_t *)T.SCOPE.TempCHD+circular;
+                q2=ch2buf+circular;
                 uint8_t i=0;
                 do {
                     uint8_t ch1raw, ch2raw, ch1end,ch2end;
-                    *p3++ = *q3++;    // get Logic data
+                    *p3++ = T.SCOPE.TempCHD[logic];     // get Logic data
                     ch1raw=(*q1++);   // get CH1 signed data
                     ch2raw=(*q2++);   // get CH2 signed data
                     circular++;
-                    if(circular>=512) {  // Circular buffer
+                    if(circular>=FFTRawLength) {  // Circular buffer
                         circular=0;
                         q1=(int8_t *)T.SCOPE.TempCH1;
-                        q2=(int8_t *)T.SCOPE.TempCH2;
-                        q3=(int8_t *)T.SCOPE.TempCHD;
+                        q2=ch2buf;
                     }
                     if(Srate) {   // Srate 0 only has 256 data points, all others have 512
                         if(testbit(CH1ctrl,chaverage)) {
@@ -608,13 +714,13 @@ void MSO(void) {
                         if(testbit(CH2ctrl,chaverage)) {
                             ch2raw=((int8_t)(ch2raw)>>1)+((int8_t)(*q2)>>1);
                         }
-                        q1++; q2++; q3++; circular++;
+                        q1++; q2++; circular++; logic++;
                     }
-                    if(circular>=512) {  // Circular buffer
+                    logic=(logic+1)&511;
+                    if(circular>=FFTRawLength) {  // Circular buffer
                         circular=0;
                         q1=(int8_t *)T.SCOPE.TempCH1;
-                        q2=(int8_t *)T.SCOPE.TempCH2;
-                        q3=(int8_t *)T.SCOPE.TempCHD;
+                        q2=ch2buf;
                     }
                     if(testbit(CH1ctrl,derivative) && i) {
                         ch1raw=(*q1)-ch1raw;
@@ -622,6 +728,7 @@ void MSO(void) {
                     if(testbit(CH2ctrl,derivative) && i) {
                         ch2raw=(*q2)-ch2raw;
                     }
+                    if(blank2) ch2raw=0;
                     ch1end = saddwsat(ch1raw, T.SCOPE.CH1.offset);
                     if(testbit(CH1ctrl,chinvert)) ch1end = 255-ch1end;
                     ch2end = saddwsat(ch2raw, T.SCOPE.CH2.offset);
@@ -683,23 +790,26 @@ void MSO(void) {
         clrbit(DMA.CH1.CTRLA, 7);
         // When MSO is stopped or in roll mode, cycle is too fast to finish sending
         // display data, so wait for the data transfer here
-        if(testbit(MStatus,stop) || testbit(Mcursors,roll) || MFFT<0x20) {
+        if(testbit(MStatus,stop) || testbit(Mcursors,roll) || MFFT<0x20 || WaterfallActive()) {
             WaitDisplay();
         }
         if(!testbit(MStatus, triggered)) {
 ///////////////////////////////////////////////////////////////////////////////
 // Erase old data
-            if(!testbit(Display, persistent)) {
+            if(!testbit(Display, persistent) && !WaterfallActive()) {
                 if(((testbit(MFFT, fftmode) || testbit(MFFT, xymode))) ||
                 (testbit(MFFT, scopemode) && (Srate<11 || testbit(Mcursors,roll))))
                 clr_display();
             }
 ///////////////////////////////////////////////////////////////////////////////
 // AWG sweep
+            // The log and list frequency sweeps run on their own timer
+            uint8_t timed = testbit(Sweep,SweepF) && (SweepCtrl&swtype);
+            SweepRun(timed);
             cli();
             if(Srate>=11 && testbit(Mcursors,roll) && !testbit(Misc,sacquired)) goto nosweep;
             clrbit(Misc,sacquired);   // Prevents frequency to change too fast in ROLL mode
-            if(testbit(Sweep,SweepF)) {
+            if(testbit(Sweep,SweepF) && !timed) {
                 uint32_t freqv;
                 freqv = pgm_read_dword_near(freqval+Srate)/4096;    // Sweep will have 256 * 16 steps
                 if(Srate<=6) {
@@ -747,11 +857,12 @@ void MSO(void) {
             }
             clrbit(Misc,bigfont);
             if(Sweep>=16) { // Sweep enabled
-                setbit(MStatus, updateawg);
+                if(Sweep>=32 || !timed) setbit(MStatus, updateawg);    // A timed sweep only changes F
                 if(testbit(Display,showset)) {
                     set_pixel(M.Sweep1>>1,DISPLAY_MAX_Y);              // Min
                     set_pixel(M.Sweep2>>1,DISPLAY_MAX_Y);              // Max
-                    set_pixel((uint8_t)(AWGsweepi>>5),DISPLAY_MAX_Y);  // Current
+                    if(timed && Sweep<32) set_pixel(SweepPixel(),DISPLAY_MAX_Y);    // Current
+                    else set_pixel((uint8_t)(AWGsweepi>>5),DISPLAY_MAX_Y);  // Current
                 }
             }
             nosweep:
@@ -779,6 +890,10 @@ void MSO(void) {
             if(testbit(Mcursors,autocur) && testbit(MFFT, scopemode)) {
                 AutoCursorV();
             }
+            // Mask test
+            if(testbit(MaskCtrl, masktest) && testbit(MFFT, scopemode)) MaskTest();
+            // Tone detector
+            if(ToneCtrl && testbit(MFFT, scopemode)) ToneTest();
         }
 ///////////////////////////////////////////////////////////////////////////////
 // Display MSO data
@@ -789,18 +904,30 @@ void MSO(void) {
                 // The fast sampling rates only show 128 samples, starting at M.HPos
                 if(Srate<11) j=M.HPos;
                 uint8_t nx, ox, ny1, oy1, ny2, oy2;
-                int8_t eech1pos, eech2pos;
-                eech1pos=eeprom_read_byte(&EECH1Pos);
-                eech2pos=eeprom_read_byte(&EECH2Pos);
+                int8_t refch1pos=RefCH1pos, refch2pos=RefCH2pos;
+                uint8_t showch1=0, showch2=0;
+                if(testbit(CH1ctrl,chon) && testbit(RefCtrl,refch1)) showch1=1;
+                if(testbit(CH2ctrl,chon) && testbit(RefCtrl,refch2)) showch2=1;
+                if(testbit(RefCtrl,refmath)) {  // REF-CH is shown at the channel's position
+                    refch1pos=M.CH1pos;
+                    refch2pos=M.CH2pos;
+                }
                 do {
                     oy1=ny1; oy2=ny2;
-                    ny1=eeprom_read_byte(&EECHREF1[j]);
-                    ny2=eeprom_read_byte(&EECHREF2[j]);
+                    ny1=T.SCOPE.REF.ch1[j];
+                    ny2=T.SCOPE.REF.ch2[j];
+                    if(testbit(RefCtrl,refmath)) {
+                        int16_t d1=128-T.SCOPE.DC.CH1data[j], d2=128-T.SCOPE.DC.CH2data[j];
+                        if(d1>127) d1=127;      // -(-128) doesn't fit in int8_t
+                        if(d2>127) d2=127;
+                        ny1=addwsat(ny1,d1);    // REF1-CH1
+                        ny2=addwsat(ny2,d2);    // REF2-CH2
+                    }
                     // Add position
-                    ny1=addwsat(ny1,eech1pos);
+                    ny1=addwsat(ny1,refch1pos);
                     ny1=ny1>>1; // Scale to LCD
                     //if(ny1>DISPLAY_MAX_Y) ny1=DISPLAY_MAX_Y;  // Commented out, ny1 is always between 0 and 127
-                    ny2=addwsat(ny2,eech2pos);
+                    ny2=addwsat(ny2,refch2pos);
                     ny2=ny2>>1; // Scale to LCD
                     //if(ny2>DISPLAY_MAX_Y) ny2=DISPLAY_MAX_Y;  // Commented out, ny2 is always between 0 and 127
 
@@ -812,17 +939,19 @@ void MSO(void) {
                     }
                     if(testbit(Display, line)) {
                         if(i==0) continue;
-                        if(testbit(CH1ctrl,chon)) set_line(nx, ny1, ox, oy1);
-                        if(testbit(CH2ctrl,chon)) set_line(nx, ny2, ox, oy2);
+                        if(showch1) set_line(nx, ny1, ox, oy1);
+                        if(showch2) set_line(nx, ny2, ox, oy2);
                     }
                     else {
-                        if(testbit(CH1ctrl,chon)) set_pixel(nx, ny1);
-                        if(testbit(CH2ctrl,chon)) set_pixel(nx, ny2);
+                        if(showch1) set_pixel(nx, ny1);
+                        if(showch2) set_pixel(nx, ny2);
                     }
                     if(Srate<11 && i>=127) break;
                     j++;
                 } while(++i);
             }            
+            if(testbit(MaskCtrl, masktest)) MaskDraw();
+            if(ToneCtrl) ToneDraw();
             if(Srate<11 || testbit(Mcursors,roll)) {
                 uint8_t k=0, prev=0;
                 // Display new data
@@ -898,26 +1027,17 @@ void MSO(void) {
 ///////////////////////////////////////////////////////////////////////////////
 // Display XY
         if(testbit(MFFT, xymode)) {
-            uint8_t *p1,*p2;
             if(testbit(Display,showset)) tiny_printp(0,0,menustxt[31]+25); // "XY MODE"
-            p1=T.SCOPE.DC.CH1data;
-            p2=T.SCOPE.DC.CH2data;
-            uint8_t i=0; do {
-                if(Srate>=11 && !testbit(Mcursors,roll)) {
-                    if(i==Index) break; // Don't display old data in slow sampling rate
-                }
-                uint8_t x = 255-(*p1++);
-                uint8_t y = (*p2++)/*-M.HPos*/;
-                set_pixel(x>>1, y>>1); // Scale to 128
-            } while(++i);
+            // Don't display old data in slow sampling rate
+            if(Srate>=11 && !testbit(Mcursors,roll)) XYDraw(Index);
+            else XYDraw(256);
             // Show reference waveforms
-            if(testbit(Mcursors, reference)) {
-                uint8_t i=0, eehpos;
-                eehpos = eeprom_read_byte(&EEHPos);
+            if(testbit(Mcursors, reference) && (RefCtrl&0x03)==0x03) {
+                uint8_t i=0;
                 do {
                     uint8_t ny1, ny2;
-                    ny1=255-eeprom_read_byte(&EECHREF1[i]);
-                    ny2=eeprom_read_byte(&EECHREF2[i])-eehpos;
+                    ny1=255-T.SCOPE.REF.ch1[i];
+                    ny2=T.SCOPE.REF.ch2[i]-RefHPos;
                     if(ny2<128) set_pixel(ny1>>1,ny2>>1);
                 } while(++i);
             }
@@ -939,7 +1059,7 @@ void MSO(void) {
                     divide = 1;  // divide by 2
                 }
                 if(testbit(MFFT,iqfft)) {   // Display new FFT data
-                    if(Display&0x03) {              // Grid
+                    if((Display&0x03) && !WaterfallActive()) {  // Grid
                         // Set dots at: (64,16), (64,32), (64,48), (64,64), (64,80), (64,96), (64,112)
                         uint8_t *p=Disp_send.DataAddress-(M.HPos*18)+(16/8);  // Locate pointer at (64,16)
                         for(uint8_t i=7; i; i--) {
@@ -951,17 +1071,42 @@ void MSO(void) {
                             p+=2;       // Move 2 bars below
                         }
 			        }
-                    fft_stuff(NULL);
-                    for(uint8_t i=0; i<FFT_N/2; i++) {
+                    fft_stuff();
+                    FFTAccumulate(T.SCOPE.FFT.magn, T.SCOPE.FFT.acc, FFT_N);
+                    if(WaterfallActive()) WaterfallLine(T.SCOPE.FFT.magn, -M.HPos, 2);
+                    else for(uint8_t i=0; i<FFT_N/2; i++) {
 				        uint8_t fftdata=T.SCOPE.FFT.magn[(uint8_t)(i-M.HPos)]>>2;
 						if(fftdata>(DISPLAY_MAX_Y-8)) fftdata=(DISPLAY_MAX_Y-8);
                         if(testbit(Display, line)) set_line(i, (DISPLAY_MAX_Y-8)-fftdata, i, (DISPLAY_MAX_Y-8));
                         else set_pixel(i, (DISPLAY_MAX_Y-8)-fftdata);
                     }
                 }
+                else if(FFTDeepOn()) {          // One channel, 512, 1024 points or zoom
+                    FFTDeep();
+                    FFTAccumulate(T.SCOPE.FFTD.magn, T.SCOPE.FFTD.acc, FFT_N/2);
+                    T.SCOPE.CH1.f=T.SCOPE.CH2.f=fft_peak(T.SCOPE.FFTD.magn);
+                    if(WaterfallActive()) WaterfallLine(T.SCOPE.FFTD.magn, 0, 1);
+                    else for(uint8_t i=0; i<FFT_N/2; i++) {
+                        uint8_t fftdata=T.SCOPE.FFTD.magn[i]>>1;
+                        if(fftdata>(DISPLAY_MAX_Y-8)) fftdata=(DISPLAY_MAX_Y-8);    // Clip
+                        if(testbit(Display, line)) set_line(i, (DISPLAY_MAX_Y-8)-fftdata, i, (DISPLAY_MAX_Y-8));
+                        else set_pixel(i, (DISPLAY_MAX_Y-8)-fftdata);
+                    }
+                    if(testbit(FFTCtrl,fftdist) && !WaterfallActive()) {
+                        Distortion(T.SCOPE.DC.CH1data);
+                        DistDraw();
+                    }
+                }
                 else {
-                    if(testbit(CH1ctrl,chon)) {     // Display new FFT data
-                        T.SCOPE.CH1.f=fft_stuff(T.SCOPE.DC.CH1data);
+                    fft_stuff();                    // Both spectra in one pass
+                    if(FFTAccumulate(T.SCOPE.FFT.magn, T.SCOPE.FFT.acc, FFT_N)) {
+                        T.SCOPE.CH1.f=fft_peak(T.SCOPE.FFT.magn);
+                        T.SCOPE.CH2.f=fft_peak(T.SCOPE.FFT.magn+FFT_N/2);
+                    }
+                    if(WaterfallActive()) {         // CH1, or CH2 if CH1 is off
+                        WaterfallLine(T.SCOPE.FFT.magn+(testbit(CH1ctrl,chon) ? 0 : FFT_N/2), 0, 1);
+                    }
+                    else if(testbit(CH1ctrl,chon)) {    // Display new FFT data
                         for(uint8_t i=0,j=0; j<FFT_N/2; i++,j++) {
     				        uint8_t fftdata=T.SCOPE.FFT.magn[j]>>divide;
 							if(fftdata>fft1pos) fftdata=fft1pos;    // Clip
@@ -969,16 +1114,27 @@ void MSO(void) {
                             else set_pixel(i, fft1pos-fftdata);
                         }
                     }
-                    if(testbit(CH2ctrl,chon)) {
-                        T.SCOPE.CH2.f=fft_stuff(T.SCOPE.DC.CH2data);
+                    if(testbit(CH2ctrl,chon) && !WaterfallActive()) {
                         // Display new FFT data
                         for(uint8_t i=0,j=0; j<FFT_N/2; i++,j++) {
-							uint8_t fftdata=T.SCOPE.FFT.magn[j]>>divide;
+							uint8_t fftdata=T.SCOPE.FFT.magn[FFT_N/2+j]>>divide;
 							if(fftdata>fft1pos) fftdata=fft1pos;    // Clip
                             if(testbit(Display, line)) set_line(i, fft2pos-fftdata, i, fft2pos);
                             else set_pixel(i, fft2pos-fftdata);
                         }
                     }
+                    if(testbit(FFTCtrl,fftdist) && !WaterfallActive()) {  // Distortion of CH1, or CH2 if CH1 is off
+                        Distortion(testbit(CH1ctrl,chon) ? T.SCOPE.DC.CH1data : T.SCOPE.DC.CH2data);
+                        DistDraw();
+                    }
+                }
+                // Marker, on CH1 or CH2 if CH1 is off
+                if(testbit(MarkerCtrl,mkon) && !WaterfallActive()) {
+                    if(testbit(MFFT,iqfft)) MarkerUpdate(T.SCOPE.FFT.magn, -M.HPos, 2, DISPLAY_MAX_Y-8);
+                    else if(FFTDeepOn()) MarkerUpdate(T.SCOPE.FFTD.magn, 0, 1, DISPLAY_MAX_Y-8);
+                    else if(testbit(CH1ctrl,chon)) MarkerUpdate(T.SCOPE.FFT.magn, 0, divide, fft1pos);
+                    else MarkerUpdate(T.SCOPE.FFT.magn+FFT_N/2, 0, divide, fft2pos);
+                    MarkerDraw();
                 }
                 // Automatic cursors
                 if(testbit(Mcursors,autocur)) {
@@ -1064,8 +1220,8 @@ void MSO(void) {
 			clrbit(MFFT,uselog);
             clrbit(CH1ctrl,chmath);
             clrbit(CH2ctrl,chmath);
-            T.SCOPE.CH1.f=fft_stuff(T.SCOPE.DC.CH1data);
-            T.SCOPE.CH2.f=fft_stuff(T.SCOPE.DC.CH2data);
+            clrbit(MFFT,iqfft);
+            fft_stuff();
 			MFFT=tempmfft;
             uint8_t MaxGain=5;
             if(MFFT<0x20) { // Meter Mode
@@ -1166,6 +1322,7 @@ checknext:
             if(testbit(Buttons,KML)) {
                 if(Menu==Mdefault) {
                     SaveEE();       // Save settings on Oscilloscope Mode exit
+                    WaterfallStop();
                     return;
                 }
                 Menu=Mdefault;
@@ -1344,6 +1501,7 @@ checknext:
                 break;
                 case MWINDOW:     // Spectrum Analyzer menu
                     if(testbit(Buttons,K1)) {    // Use Hamming Window
+                        FFTWindow=WIN_MFFT;
 						if(testbit(MFFT,hamming)) clrbit(MFFT,hamming);
                         else {
                             setbit(MFFT, hamming);
@@ -1352,6 +1510,7 @@ checknext:
                         }
                     }
                     if(testbit(Buttons,K2)) {    // Use Hann Window
+                        FFTWindow=WIN_MFFT;
 						if(testbit(MFFT,hann)) clrbit(MFFT,hann);
                         else {
                             clrbit(MFFT, hamming);
@@ -1360,6 +1519,7 @@ checknext:
                         }
                     }
                     if(testbit(Buttons,K3)) {    // Use Blackman Window
+                        FFTWindow=WIN_MFFT;
 						if(testbit(MFFT,blackman)) clrbit(MFFT,blackman);
                         else {
                             clrbit(MFFT, hamming);
@@ -1368,6 +1528,15 @@ checknext:
                         }
                     }
                 break;
+                case MWINDOW2:    // More windows, these replace the MWINDOW ones
+                    clrbit(MFFT, hamming);
+                    clrbit(MFFT, hann);
+                    clrbit(MFFT, blackman);
+                    if(testbit(Buttons,K1)) FFTWindow = (FFTWindow==WIN_FLATTOP) ? WIN_MFFT : WIN_FLATTOP;
+                    if(testbit(Buttons,K2)) FFTWindow = (FFTWindow==WIN_KAISER) ? WIN_MFFT : WIN_KAISER;
+                    if(testbit(Buttons,K3)) FFTWindow = WIN_MFFT;   // Rectangular
+                    FFTAccReset();
+                break;
                 case MSOURCE:     // Trigger Source
                     if(testbit(Buttons,K1)) {    // Trigger source is CH1
                         M.Tsource = 0;
@@ -1492,6 +1661,96 @@ checknext:
                     if(testbit(Buttons,K2)) Menu=MDISPLAY2;      // Display Menu
                     if(testbit(Buttons,K3)) Menu=MAWG2;          // AWG Menu
                 break;
+                case MMAIN6:     // Menu Select 6: Tools
+                    if(testbit(Buttons,K1)) {   // Bode plot
+                        Buttons=0;
+                        SaveEE();
+                        Bode();
+                        Menu=Mdefault;
+                        setbit(Misc,redraw);
+                    }
+                    if(testbit(Buttons,K2)) Menu=MMASK1;    // Mask test
+                    if(testbit(Buttons,K3)) togglebit(FFTCtrl, fftdist);    // Distortion analysis
+                break;
+                case MMASK1:     // Mask test
+                    if(testbit(Buttons,K1)) {   // New mask from current CH1 trace
+                        MaskNew();
+                        setbit(MaskCtrl, masktest);
+                    }
+                    if(testbit(Buttons,K2)) Menu=MMASKTOL;  // Tolerance
+                    if(testbit(Buttons,K3)) {
+                        togglebit(MaskCtrl, masktest);
+                        if(testbit(MaskCtrl, masktest)) MaskLoad();
+                    }
+                break;
+                case MMASK2:     // Mask test options
+                    if(testbit(Buttons,K1)) togglebit(MaskCtrl, maskstop);  // Stop on failure
+                    if(testbit(Buttons,K2)) togglebit(MaskCtrl, masksound); // Beep on failure
+                    if(testbit(Buttons,K3)) MaskReset();                    // Clear counters
+                break;
+                case MREF:     // Reference waveforms
+                    if(testbit(Buttons,K1)) {   // Save waveform to the active slot
+                        if(RefSave(RefSlot)) setbit(Mcursors, reference);
+                        else Menu=MREFSLOT;     // Didn't fit
+                    }
+                    if(testbit(Buttons,K2)) {   // Select slot
+                        RefLoad(RefSlot);
+                        Menu=MREFSLOT;
+                    }
+                    if(testbit(Buttons,K3)) togglebit(RefCtrl, refmath);    // REF-CH
+                break;
+                case MFFTSIZE:  // FFT size, 512 and 1024 points show one channel
+                    if(testbit(Buttons,K1)) FFTSize=FFT_256;
+                    if(testbit(Buttons,K2)) FFTSize=FFT_512;
+                    if(testbit(Buttons,K3)) FFTSize=FFT_1024;
+                    FFTZoom=0;
+                    setbit(MStatus, update);    // New capture length
+                break;
+                case MFFTAVG:   // FFT averaging
+                    if(testbit(Buttons,K1)) {   // Average
+                        clrbit(FFTCtrl, fftmax);
+                        togglebit(FFTCtrl, fftavg);
+                        if(testbit(FFTCtrl, fftavg)) Menu=MFFTAVGN;
+                    }
+                    if(testbit(Buttons,K2)) {   // Max hold
+                        clrbit(FFTCtrl, fftavg);
+                        togglebit(FFTCtrl, fftmax);
+                    }
+                    FFTAccReset();              // K3: Restart
+                break;
+                case MTONES:    // Tone detector, the same key again turns it off
+                    if(testbit(Buttons,K1)) ToneCtrl = (ToneCtrl==TONE_DTMF) ? TONE_OFF : TONE_DTMF;
+                    if(testbit(Buttons,K2)) ToneCtrl = (ToneCtrl==TONE_50HZ) ? TONE_OFF : TONE_50HZ;
+                    if(testbit(Buttons,K3)) ToneCtrl = (ToneCtrl==TONE_60HZ) ? TONE_OFF : TONE_60HZ;
+                    ToneReset();
+                break;
+                case MFFTVIEW:  // Spectrum display
+                    if(testbit(Buttons,K1)) clrbit(FFTCtrl, fftwater);  // Trace
+                    if(testbit(Buttons,K2)) setbit(FFTCtrl, fftwater);  // Waterfall
+                    if(testbit(Buttons,K3)) WaterfallStop();            // Clear, starts again on the next frame
+                break;
+                case MMARKER:   // Spectrum markers
+                    if(testbit(Buttons,K1)) {   // Highest peak, press again to remove the marker
+                        if(testbit(MarkerCtrl,mkon)) MarkerCtrl=0;
+                        else MarkerCtrl=(1<<mkon) | (1<<mkpeak);
+                    }
+                    if(testbit(Buttons,K2)) {   // Next lower peak
+                        if(testbit(MarkerCtrl,mkon)) setbit(MarkerCtrl,mknext);
+                        else MarkerCtrl=(1<<mkon) | (1<<mkpeak);
+                    }
+                    if(testbit(Buttons,K3) && testbit(MarkerCtrl,mkon)) MarkerDelta();
+                break;
+                case MXY:       // XY options
+                    if(testbit(Buttons,K1)) {   // Persistence: off, 2, 4, 8 frames
+                        XYCtrl=(XYCtrl&~xypersist) | ((XYCtrl+1)&xypersist);
+                    }
+                    if(testbit(Buttons,K2)) togglebit(XYCtrl, xyphase);
+                    if(testbit(Buttons,K3)) {   // Z blanking: off, bit 0 to bit 7
+                        if(!testbit(XYCtrl,xyzblank)) XYCtrl=(XYCtrl&~xyzbit) | (1<<xyzblank);
+                        else if((XYCtrl&xyzbit)==xyzbit) clrbit(XYCtrl,xyzblank);
+                        else XYCtrl+=0x10;
+                    }
+                break;
                 case MAWG2:     // AWG Menu 2
                     if(testbit(Buttons,K1)) Menu = MAWG;         // Waveform Type
                     if(testbit(Buttons,K2)) Menu = MAWG6;        // Go to Advanced Settings
@@ -1499,7 +1758,7 @@ checknext:
                 break;
                 case MAWG4:     // AWG Menu 4
                     if(testbit(Buttons,K1)) M.AWGtype = 4;  // Exponential
-                    if(testbit(Buttons,K2)) M.AWGtype = 0;  // Noise
+                    if(testbit(Buttons,K2)) { M.AWGtype = 0; Menu=MNOISE; }  // Noise
                     if(testbit(Buttons,K3)) M.AWGtype = 5;  // Custom
                     setbit(MStatus, updateawg);
                 break;
@@ -1571,13 +1830,8 @@ checknext:
                     if(testbit(Buttons,K3)) {   // Show Reference
                         togglebit(Mcursors, reference);
                         if(testbit(Mcursors, reference)) {
-                            // Save waveform to EEPROM
-                            eeprom_write_byte(&EECH1Pos, M.CH1pos);     // Save CH1 position
-                            eeprom_write_byte(&EECH2Pos, M.CH2pos);     // Save CH2 position
-                            eeprom_write_byte(&EEHPos, M.HPos);         // Save Horizontal position
-                            eeprom_busy_wait();
-                            eeprom_write_block(T.SCOPE.DC.CH1data, EECHREF1, 256);
-                            eeprom_write_block(T.SCOPE.DC.CH2data, EECHREF2, 256);
+                            // Show the active slot, or save the waveform if the slot is empty
+                            if(!RefLoad(RefSlot)) RefSave(RefSlot);
                         }
                     }
                 break;
@@ -1730,6 +1984,47 @@ checknext:
                     if(testbit(Buttons,K2)) Menu=MAWGDUTY;   // Duty Cycle
                     if(testbit(Buttons,K3)) Menu=MAWGOFF;    // Offset
                 break;
+                case MAWG7:     // AWG engine
+                    if(testbit(Buttons,K1)) clrbit(AWGCtrl,awgdds);  // Buffer with 1 to 32 cycles
+                    if(testbit(Buttons,K2)) setbit(AWGCtrl,awgdds);  // Phase accumulator
+                    if(testbit(Buttons,K3)) Menu=MAWG9;             // Burst
+                    setbit(MStatus, updateawg);
+                break;
+                case MAWG8:     // AWG modulation, pressing the active one turns it off
+                    if(testbit(Buttons,K1)) ModCtrl=(ModCtrl&modwave) | (((ModCtrl&modtype)==MOD_AM)?  MOD_OFF: MOD_AM);
+                    if(testbit(Buttons,K2)) ModCtrl=(ModCtrl&modwave) | (((ModCtrl&modtype)==MOD_FM)?  MOD_OFF: MOD_FM);
+                    if(testbit(Buttons,K3)) ModCtrl=(ModCtrl&modwave) | (((ModCtrl&modtype)==MOD_PWM)? MOD_OFF: MOD_PWM);
+                    if(ModCtrl&modtype) Menu=MMODRATE;
+                    setbit(MStatus, updateawg);
+                break;
+                case MAWG9:     // AWG burst
+                    if(testbit(Buttons,K1)) AWGCtrl&=~((1<<awgburst) | (1<<awgtrig));   // Continuous
+                    if(testbit(Buttons,K2)) {   // One burst each time the wave is built
+                        setbit(AWGCtrl,awgburst);
+                        clrbit(AWGCtrl,awgtrig);
+                    }
+                    if(testbit(Buttons,K3)) AWGCtrl|=(1<<awgburst) | (1<<awgtrig);    // On the trigger source
+                    if(testbit(AWGCtrl,awgburst)) Menu=MBURST;
+                    setbit(MStatus, updateawg);
+                break;
+                case MSWTYPE:   // Sweep type
+                    if(testbit(Buttons,K1)) SweepCtrl=(SweepCtrl&~swtype) | (((SweepCtrl&swtype)==SWEEP_LOG)?  SWEEP_LINEAR: SWEEP_LOG);
+                    if(testbit(Buttons,K2)) SweepCtrl=(SweepCtrl&~swtype) | (((SweepCtrl&swtype)==SWEEP_LIST)? SWEEP_LINEAR: SWEEP_LIST);
+                    if(testbit(Buttons,K3)) togglebit(SweepCtrl,swmarker);  // Marker on EXT TRIG, off at power up
+                break;
+                case MNOISE:    // Noise generator, the one selected goes back to the repeated table
+                    if(testbit(Buttons,K1)) NoiseCtrl = (NoiseCtrl==NOISE_WHITE)? NOISE_TABLE: NOISE_WHITE;
+                    if(testbit(Buttons,K2)) NoiseCtrl = (NoiseCtrl==NOISE_PINK)?  NOISE_TABLE: NOISE_PINK;
+                    if(testbit(Buttons,K3)) NoiseCtrl = (NoiseCtrl==NOISE_BAND)?  NOISE_TABLE: NOISE_BAND;
+                    if(NoiseCtrl==NOISE_BAND) Menu=MAWGFREQ;    // The cutoff frequency
+                    setbit(MStatus, updateawg);
+                break;
+                case MHARM:     // Harmonic synthesis
+                    if(testbit(Buttons,K1)) M.AWGtype = AWG_HARMONIC;
+                    if(testbit(Buttons,K2)) Menu=MHARMAMP;
+                    if(testbit(Buttons,K3)) Menu=MHARMPH;
+                    setbit(MStatus, updateawg);
+                break;
                 case MSWMODE:
                     if(testbit(Buttons,K1)) togglebit(Sweep,swdown);    // Sweep direction
                     if(testbit(Buttons,K2)) togglebit(Sweep,pingpong);   // Ping Pong
@@ -1743,13 +2038,20 @@ checknext:
                     }
                 break;
                 case MUART:    // Baud Rate Menu 1
+                    UARTFound=2;                // Clear the detection message
                     if(testbit(Buttons,K1)) {   // Change Baud Rate
-                        uint8_t baud;
-                        baud=Sniffer&0x1F;
-                        baud++;
-                        baud=baud&0x1F;
-                        Sniffer&=0xE0;
-                        Sniffer|=baud;
+                        if(UARTCustom || UARTInvert) {  // Back to the menu rate in Sniffer, normal lines
+                            UARTCustom=0;
+                            UARTInvert=0;
+                        }
+                        else {
+                            uint8_t baud;
+                            baud=Sniffer&0x1F;
+                            baud++;
+                            baud=baud&0x1F;
+                            Sniffer&=0xE0;
+                            Sniffer|=baud;
+                        }
                     }
                     if(testbit(Buttons,K2)) {   // Parity
                         if(!testbit(Sniffer,parmode)) {
@@ -1849,6 +2151,62 @@ checknext:
                         if(testbit(Buttons,K3)) M.HPos++;
                     }
                 break;
+                case MMASKTOL:  // Mask tolerance
+                    if(testbit(Buttons,K2)) { if(MaskTol>1)  MaskTol--; }
+                    if(testbit(Buttons,K3)) { if(MaskTol<64) MaskTol++; }
+                    MaskLoad();
+                break;
+                case MREFSLOT:  // Reference slot
+                    if(testbit(Buttons,K2)) { if(RefSlot) RefSlot--; }
+                    if(testbit(Buttons,K3)) { if(RefSlot<REF_SLOTS-1) RefSlot++; }
+                    RefLoad(RefSlot);
+                break;
+                case MFFTAVGN:  // Frames averaged, powers of 2
+                    if(testbit(Buttons,K1)) togglebit(FFTCtrl, fftexp);  // Linear or exponential
+                    if(testbit(Buttons,K2)) { if((FFTCtrl&fftavgn)>1) FFTCtrl--; }
+                    if(testbit(Buttons,K3)) { if((FFTCtrl&fftavgn)<6) FFTCtrl++; }
+                    FFTAccReset();
+                break;
+                case MFFTZOOM:  // FFT zoom, the horizontal position sets the center
+                    if(testbit(Buttons,K1)) FFTZoom=0;
+                    if(testbit(Buttons,K2)) { if(FFTZoom) FFTZoom--; }
+                    if(testbit(Buttons,K3)) { if(FFTZoom<FFT_ZOOM) FFTZoom++; }
+                    setbit(MStatus, update);    // New capture length
+                break;
+                case MMODRATE:  // Modulation rate
+                    if(testbit(Buttons,K1)) {   // Modulating wave: sine, square, triangle
+                        if((ModCtrl&modwave)==MOD_TRIANGLE) ModCtrl&=~modwave;
+                        else ModCtrl+=MOD_SQUARE;
+                    }
+                    if(testbit(Buttons,K2)) { if(ModRate) ModRate--; }
+                    if(testbit(Buttons,K3)) { if(ModRate<MOD_RATES-1) ModRate++; }
+                    setbit(MStatus, updateawg);
+                break;
+                case MMODDEPTH: // Modulation depth
+                    if(testbit(Buttons,K1)) Menu=MMODRATE;
+                    if(testbit(Buttons,K2)) { if(ModDepth) ModDepth--; }
+                    if(testbit(Buttons,K3)) { if(ModDepth<100) ModDepth++; }
+                    setbit(MStatus, updateawg);
+                break;
+                case MBURST:    // Burst cycles, K1 starts the burst again
+                    if(testbit(Buttons,K2)) { if(AWGBurst>1) AWGBurst--; }
+                    if(testbit(Buttons,K3)) { if(AWGBurst<255) AWGBurst++; }
+                    setbit(MStatus, updateawg);
+                break;
+                case MHARMAMP:  // Harmonic amplitude, K1 selects the harmonic
+                    if(testbit(Buttons,K1)) harmonic=(harmonic+1)%HARMONICS;
+                    if(testbit(Buttons,K2)) { if(HarmAmp[harmonic])     HarmAmp[harmonic]--; }
+                    if(testbit(Buttons,K3)) { if(HarmAmp[harmonic]<100) HarmAmp[harmonic]++; }
+                    if(M.AWGtype==AWG_HARMONIC) AWGFlush();    // Build the shape again
+                    setbit(MStatus, updateawg);
+                break;
+                case MHARMPH:   // Harmonic phase, K1 selects the harmonic
+                    if(testbit(Buttons,K1)) harmonic=(harmonic+1)%HARMONICS;
+                    if(testbit(Buttons,K2)) HarmPhase[harmonic] = (HarmPhase[harmonic]>=5) ? HarmPhase[harmonic]-5 : HarmPhase[harmonic]+355;
+                    if(testbit(Buttons,K3)) HarmPhase[harmonic] = (HarmPhase[harmonic]<355) ? HarmPhase[harmonic]+5 : HarmPhase[harmonic]-355;
+                    if(M.AWGtype==AWG_HARMONIC) AWGFlush();    // Build the shape again
+                    setbit(MStatus, updateawg);
+                break;
                 case MSWSPEED:  // Sweep speed
                     if(testbit(Buttons,K2)) { if(M.SWSpeed>1)    M.SWSpeed--; }
                     if(testbit(Buttons,K3)) { if(M.SWSpeed<127)  M.SWSpeed++; }
@@ -1941,7 +2299,8 @@ checknext:
         if(testbit(MStatus, update)) {
             clrbit(MStatus, update);
             Apply();        // Apply new oscilloscope settings
-            if(testbit(Misc, redraw) || testbit(Display, persistent)) {
+            XYClear();      // The persistence starts again with the new settings
+            if((testbit(Misc, redraw) || testbit(Display, persistent)) && !WaterfallActive()) {
                 clrbit(Misc, redraw);
                 clr_display();
             }
@@ -1994,6 +2353,50 @@ checknext:
                                 (i==1 && testbit(Mcursors, cursorh1)) ||
                                 (i==2 && testbit(Mcursors, cursorh2)) ) setbit(Misc,negative);
                         break;
+                        case MWINDOW2:
+                            if(i+1==FFTWindow) setbit(Misc,negative);
+                        break;
+                        case MFFTVIEW:
+                            if( (i==0 && !testbit(FFTCtrl,fftwater)) ||
+                                (i==1 &&  testbit(FFTCtrl,fftwater)) ) setbit(Misc,negative);
+                        break;
+                        case MMARKER:
+                            if( (i==0 && testbit(MarkerCtrl,mkon)) ||
+                                (i==2 && testbit(MarkerCtrl,mkdelta)) ) setbit(Misc,negative);
+                        break;
+                        case MAWG8:
+                            if( (i==0 && (ModCtrl&modtype)==MOD_AM) ||
+                                (i==1 && (ModCtrl&modtype)==MOD_FM) ||
+                                (i==2 && (ModCtrl&modtype)==MOD_PWM) ) setbit(Misc,negative);
+                        break;
+                        case MAWG7:
+                            if( (i==0 && !testbit(AWGCtrl,awgdds)) ||
+                                (i==1 &&  testbit(AWGCtrl,awgdds)) ||
+                                (i==2 &&  testbit(AWGCtrl,awgburst)) ) setbit(Misc,negative);
+                        break;
+                        case MAWG9:
+                            if( (i==0 && !testbit(AWGCtrl,awgburst)) ||
+                                (i==1 &&  testbit(AWGCtrl,awgburst) && !testbit(AWGCtrl,awgtrig)) ||
+                                (i==2 &&  testbit(AWGCtrl,awgtrig)) ) setbit(Misc,negative);
+                        break;
+                        case MSWTYPE:
+                            if( (i==0 && (SweepCtrl&swtype)==SWEEP_LOG) ||
+                                (i==1 && (SweepCtrl&swtype)==SWEEP_LIST) ||
+                                (i==2 && testbit(SweepCtrl,swmarker)) ) setbit(Misc,negative);
+                        break;
+                        case MHARM:
+                            if(  i==0 && M.AWGtype==AWG_HARMONIC) setbit(Misc,negative);
+                        break;
+                        case MNOISE:
+                            if( (i==0 && NoiseCtrl==NOISE_WHITE) ||
+                                (i==1 && NoiseCtrl==NOISE_PINK) ||
+                                (i==2 && NoiseCtrl==NOISE_BAND) ) setbit(Misc,negative);
+                        break;
+                        case MXY:
+                            if( (i==0 && (XYCtrl&xypersist)) ||
+                                (i==1 && testbit(XYCtrl,xyphase)) ||
+                                (i==2 && testbit(XYCtrl,xyzblank)) ) setbit(Misc,negative);
+                        break;
                         case MWINDOW:
                             if( (i==0 && testbit(MFFT, hamming)) ||
                                 (i==1 && testbit(MFFT, hann)) ||
@@ -2135,6 +2538,29 @@ checknext:
                                 (i==1 && testbit(Sweep,pingpong)) ||
                                 (i==2 && testbit(Sweep,SWAccel)) ) setbit(Misc,negative);
                         break;
+                        case MMAIN6:
+                            if(  i==2 && testbit(FFTCtrl,fftdist)) setbit(Misc,negative);
+                        break;
+                        case MMASK1:
+                            if(  i==2 && testbit(MaskCtrl,masktest)) setbit(Misc,negative);
+                        break;
+                        case MMASK2:
+                            if( (i==0 && testbit(MaskCtrl,maskstop)) ||
+                                (i==1 && testbit(MaskCtrl,masksound)) ) setbit(Misc,negative);
+                        break;
+                        case MREF:
+                            if(  i==2 && testbit(RefCtrl,refmath)) setbit(Misc,negative);
+                        break;
+                        case MFFTSIZE:
+                            if(i==FFTSize && !FFTZoom) setbit(Misc,negative);
+                        break;
+                        case MFFTAVG:
+                            if( (i==0 && testbit(FFTCtrl,fftavg)) ||
+                                (i==1 && testbit(FFTCtrl,fftmax)) ) setbit(Misc,negative);
+                        break;
+                        case MTONES:
+                            if(i+1==ToneCtrl) setbit(Misc,negative);
+                        break;
                     }
                     // Print text
                     char ch;
@@ -2193,14 +2619,28 @@ checknext:
                 break;
                 case MUART:
                     putchar3x6(0x35+((Sniffer&0x18)>>3)); // UART Data Bits
-                    tiny_printp(8,TEXT_LAST_LINE,baudtxt[Sniffer&0x07]); // UART Baud Rate
-                    if(testbit(Sniffer,parmode)) {
-                        if(testbit(Sniffer,parity)) tiny_printp(44,TEXT_LAST_LINE,PSTR("ODD PARITY"));
-                        else tiny_printp(40,TEXT_LAST_LINE,PSTR("EVEN PARITY"));
+                    if(UARTInvert) setbit(Misc,negative);   // Inverted lines
+                    if(UARTCustom) {            // Detected rate, not in the menu
+                        uint32_t b=32000000/UARTCustom;
+                        char d[6];
+                        uint8_t n=0;
+                        do { d[n++]='0'+b%10; b/=10; } while(b);
+                        lcd_goto(8,TEXT_LAST_LINE);
+                        while(n) putchar3x6(d[--n]);
+                    }
+                    else tiny_printp(8,TEXT_LAST_LINE,baudtxt[Sniffer&0x07]); // UART Baud Rate
+                    clrbit(Misc,negative);
+                    if(UARTFound==0) tiny_printp(48,TEXT_LAST_LINE,PSTR("NOT FOUND"));
+                    else if(UARTFound==1) tiny_printp(48,TEXT_LAST_LINE,PSTR("BAUD ONLY"));
+                    else {
+                        if(testbit(Sniffer,parmode)) {
+                            if(testbit(Sniffer,parity)) tiny_printp(44,TEXT_LAST_LINE,PSTR("ODD PARITY"));
+                            else tiny_printp(40,TEXT_LAST_LINE,PSTR("EVEN PARITY"));
+                        }
+                        else tiny_printp(48,TEXT_LAST_LINE,PSTR("NO PARITY"));
+                        if(testbit(Sniffer,stopbit)) tiny_printp(92,TEXT_LAST_LINE,PSTR("2 STOPBIT"));
+                        else tiny_printp(92,TEXT_LAST_LINE,PSTR("1 STOPBIT"));
                     }
-                    else tiny_printp(48,TEXT_LAST_LINE,PSTR("NO PARITY"));
-                    if(testbit(Sniffer,stopbit)) tiny_printp(92,TEXT_LAST_LINE,PSTR("2 STOPBIT"));
-                    else tiny_printp(92,TEXT_LAST_LINE,PSTR("1 STOPBIT"));
                 break;
                 case MPOSTT:
                     if(Srate<11) {  // Post trigger only used in fast sampling
@@ -2214,18 +2654,13 @@ checknext:
                     }
                 break;
                 case MAWGFREQ:  // Frequency
-                    {
-                        uint32_t Numerator = cycles*(F_CPU/256)*100;
-                        if(M.AWGdesiredF<100000) {
-                            uint32_t Denominator = TCD1.PER; 
-                            if(TCD1.CTRLA != 0x01) Denominator*=256;
-                            printF(0,TEXT_LAST_LINE,(Numerator/(Denominator+1))*1000);
-                            print3x6(STR_KHZ+1);   // "HZ"
-                        }
-                        else {
-                            printF(0,TEXT_LAST_LINE,Numerator/(TCD1.PER+1));
-                            print3x6(STR_KHZ);     // "KHZ"
-                        }
+                    if(M.AWGdesiredF<100000) {
+                        printF(0,TEXT_LAST_LINE,AWGFrequency()*1000);
+                        print3x6(STR_KHZ+1);   // "HZ"
+                    }
+                    else {
+                        printF(0,TEXT_LAST_LINE,AWGFrequency());
+                        print3x6(STR_KHZ);     // "KHZ"
                     }
                 break;
                 case MTLEVEL:   // Trigger Level
@@ -2252,12 +2687,77 @@ checknext:
                     print3x6(STR_F2+1); printV((int16_t)(128-M.Window2)*128,tempGain,tempCtrl); print3x6(textV_Unit);
                 break;
                 case MSW1:  // "1:"
-                    print3x6(STR_F1+1); printN3x6(M.Sweep1);
-                break;
                 case MSW2:  // "2:"
-                    print3x6(STR_F2+1); printN3x6(M.Sweep2);
-                    break;
+                    {
+                        uint8_t sw;
+                        if(Menu==MSW1) { print3x6(STR_F1+1); sw=M.Sweep1; }
+                        else           { print3x6(STR_F2+1); sw=M.Sweep2; }
+                        if((SweepCtrl&swtype)==SWEEP_LOG) {     // Frequency of the log sweep
+                            uint32_t f=SweepLogF((uint16_t)sw*SWEEP_SCALE);
+                            if(f<100000) {
+                                printF(8,TEXT_LAST_LINE,f*1000);
+                                print3x6(STR_KHZ+1);   // "HZ"
+                            }
+                            else {
+                                printF(8,TEXT_LAST_LINE,f);
+                                print3x6(STR_KHZ);     // "KHZ"
+                            }
+                        }
+                        else printN3x6(sw);
+                    }
+                break;
                 case MHPOS: print3x6(STR_STOP); break;
+                case MMASKTOL:
+                    print3x6(PSTR("TOL ")); printN3x6(MaskTol);
+                break;
+                case MREFSLOT:
+                    print3x6(PSTR("SLOT")); putchar3x6('1'+RefSlot);
+                    if(testbit(RefCtrl,reffull)) print3x6(PSTR(" FULL"));
+                    else if(!(RefCtrl&0x03)) print3x6(PSTR(" EMPTY"));
+                    print3x6(PSTR(" USED ")); printN3x6((uint32_t)RefUsed*100/REF_POOL);
+                    putchar3x6('%');
+                break;
+                case MFFTAVGN:
+                    if(testbit(FFTCtrl,fftexp)) print3x6(PSTR("EXP "));
+                    else print3x6(PSTR("LIN "));
+                    printN3x6(1<<(FFTCtrl&fftavgn));
+                break;
+                case MFFTZOOM:
+                    print3x6(PSTR("ZOOM "));
+                    if(FFTZoom) { putchar3x6('X'); printN3x6(1<<FFTZoom); }
+                    else print3x6(PSTR("OFF"));
+                break;
+                case MMODRATE:
+                    if((ModCtrl&modwave)==MOD_SQUARE) print3x6(PSTR("SQR"));
+                    else if((ModCtrl&modwave)==MOD_TRIANGLE) print3x6(PSTR("TRI"));
+                    else print3x6(PSTR("SIN"));
+                    if(ModFrequency()<100000) {
+                        printF(12,TEXT_LAST_LINE,ModFrequency()*1000);
+                        print3x6(STR_KHZ+1);   // "HZ"
+                    }
+                    else {
+                        printF(12,TEXT_LAST_LINE,ModFrequency());
+                        print3x6(STR_KHZ);     // "KHZ"
+                    }
+                    if(ModOff) print3x6(PSTR(" OFF >6.25KHZ"));
+                break;
+                case MMODDEPTH:
+                    print3x6(PSTR("DEPTH ")); printN3x6(ModDepth); putchar3x6('%');
+                    if(ModOff) print3x6(PSTR(" OFF >6.25KHZ"));
+                break;
+                case MBURST:
+                    print3x6(PSTR("BURST ")); printN3x6(AWGBurst);
+                break;
+                case MHARMAMP:
+                    putchar3x6('H'); printN3x6(harmonic+1);
+                    print3x6(PSTR(" AMP ")); printN3x6(HarmAmp[harmonic]); putchar3x6('%');
+                break;
+                case MHARMPH:
+                    putchar3x6('H'); printN3x6(harmonic+1);
+                    print3x6(PSTR(" PHASE "));
+                    if(HarmPhase[harmonic]>=100) putchar3x6('0'+HarmPhase[harmonic]/100);
+                    printN3x6(HarmPhase[harmonic]%100);
+                break;
                 case MSWSPEED:
                     printN3x6(AWGspeed);
                 break;
@@ -2319,14 +2819,14 @@ checknext:
                 }
             }
             // Horizontal Cursors (or XY cursors)
-            if((testbit(Mcursors, cursorh1) && testbit(CH1ctrl,chon)) ||
-                (testbit(Mcursors, cursorh2) && testbit(CH2ctrl,chon))) ShowCursorH();
-            if(!testbit(MFFT,xymode)) { // Vertical Cursors
+            if(((testbit(Mcursors, cursorh1) && testbit(CH1ctrl,chon)) ||
+                (testbit(Mcursors, cursorh2) && testbit(CH2ctrl,chon))) && !WaterfallActive()) ShowCursorH();
+            if(!testbit(MFFT,xymode) && !WaterfallActive()) { // Vertical Cursors
                 if(testbit(Mcursors, cursorv)) ShowCursorV();
             }
             // Display time and gain settings
             uint8_t ypos=0;
-            if(testbit(Display, showset)) {
+            if(testbit(Display, showset) && !WaterfallActive()) {
                 if(testbit(CH1ctrl,chon)) {
                     if(testbit(CH1ctrl,chmath)) {
                         lcd_goto(88,0);
@@ -2378,6 +2878,22 @@ checknext:
                 if(testbit(MFFT,fftmode)) {
                     tiny_printp(89,ypos,freqtxt[Srate]);    // Display Nyquist Frequency
                     print3x6(PSTR("HZ MAX"));
+                    if(testbit(FFTCtrl,fftmax)) {
+                        ypos++;
+                        tiny_printp(96,ypos,PSTR("MAX HOLD"));
+                    }
+                    else if(testbit(FFTCtrl,fftavg)) {
+                        ypos++;
+                        lcd_goto(96,ypos);
+                        if(testbit(FFTCtrl,fftexp)) print3x6(PSTR("EXP "));
+                        else { printN3x6(FFTFrames); putchar3x6('/'); }
+                        printN3x6(1<<(FFTCtrl&fftavgn));
+                    }
+                    if(FFTZoom && FFTDeepOn()) {
+                        ypos++;
+                        tiny_printp(96,ypos,PSTR("ZOOM X"));
+                        printN3x6(1<<FFTZoom);
+                    }
                 }
                 else {
                     tiny_printp(96,ypos,ratetxt[Srate]);    // Display time base
@@ -2472,6 +2988,7 @@ checknext:
                     clrbit(Misc,bigfont);
                 }
             }
+            if(WaterfallActive()) WaterfallOverlay();
         }
 ///////////////////////////////////////////////////////////////////////////////
 // Finished writing to screen, now use a DMA to transfer data to the display
@@ -2482,7 +2999,7 @@ checknext:
         WaitDisplay();      // Finish last transmission
         dma_display();      // Send new data
         if(testbit(USB.STATUS,USB_SUSPEND_bp) && USB.ADDR) USB_ResetInterface();
-        if(!testbit(MStatus,stop) && (Srate<11 || Index==0)) {
+        if(!testbit(MStatus,stop) && (Srate<11 || Index==0) && !WaterfallActive()) {
             if(!(Srate>=11 && testbit(Mcursors,roll))) {
                 if(testbit(Display, trgtimeout)) {
                     ONGRN();
@@ -2501,7 +3018,7 @@ checknext:
         }
 
         clrbit(Display, trgtimeout);         
-        if(Srate<11 && MFFT>=0x20) {    // Use display double buffer with fast sample rates and not in Meter Mode
+        if(Srate<11 && MFFT>=0x20 && !WaterfallActive()) {    // Use display double buffer with fast sample rates and not in Meter Mode, nor waterfall
             SwitchBuffers();            // Switch buffers
         }
 		if(testbit(MStatus, updateawg)) BuildWave();
@@ -2555,55 +3072,93 @@ void GoingtoMeter(void) {
     T.SCOPE.adjusting=7;            // First adjusting step
 }
 
-uint8_t fft_stuff(uint8_t *p) {
+// Multiply by 1/sqrt(2) and saturate to 16 bits
+static int16_t fft_scale(int32_t v) {
+    v=(v*23170)>>15;
+    if(v>32767) v=32767;
+    if(v<-32768) v=-32768;
+    return v;
+}
+
+// IQ: CH1 is the real part and CH2 the imaginary part, FFT_N bins in magn.
+// Otherwise both real channels are packed in one complex FFT, Z = FFT(CH1 + jCH2),
+// and separated with the even/odd symmetry:
+//   CH1[k] = (Z[k] + Z*[N-k])/2        CH2[k] = (Z[k] - Z*[N-k])/2j
+// CH1 goes to magn[0..FFT_N/2-1], CH2 to magn[FFT_N/2..FFT_N-1].
+// The spectra are scaled by sqrt(2) to match the old separate real FFTs.
+void fft_stuff(void) {
 	const int8_t *windowp;                              // Pointer to window table
-    if(testbit(MFFT, hamming)) windowp=Hamming;         // Apply Hamming window
-    else if(testbit(MFFT, hann)) windowp=Hann;          // Apply Hann window
-    else if(testbit(MFFT, blackman)) windowp=Blackman;  // Apply Blackman window
-	else setbit(Misc, bigfont);		// Temporally use this bit for "no window"
-	if(testbit(MFFT,iqfft)) {
-        const uint8_t *p1 = T.SCOPE.DC.CH1data;             // Pointer to ch1 data
-        const uint8_t *p2 = T.SCOPE.DC.CH2data;		        // Pointer to ch2 data
-        uint8_t i=0;
-        do {
-            uint8_t ch1,ch2;
-		    uint8_t w=pgm_read_byte_near(windowp);  // Get window data
-		    if(testbit(Misc,bigfont)) w=127;        // No window
-		    if(i<127) windowp++;                    // Window symmetry
-		    if(i>127) windowp--;                    // (only stored half of window)
-            ch1=(int8_t)((*p1++)-128);              // Convert to signed char
-            ch2=(int8_t)((*p2++)-128);              // Convert to signed char
-            T.SCOPE.FFT.bfly[i].r=FMULS(ch1, w);
-		    T.SCOPE.FFT.bfly[i].i=FMULS(ch2, w);
-        } while (++i);
-	}
-	else {
-        uint8_t i=0;
-        do {
-            uint8_t ch;
-		    uint8_t w=pgm_read_byte_near(windowp);  // Get window data
-		    if(testbit(Misc,bigfont)) w=127;        // No window
-		    if(i<127) windowp++;                    // Window symmetry
-		    if(i>127) windowp--;                    // (only stored half of window)
-            ch=(int8_t)((*p++)-128);                // Convert to signed char
-            T.SCOPE.FFT.bfly[i].r=T.SCOPE.FFT.bfly[i].i=(signed int)(FMULS8(ch, w)*256);
-        } while (++i);
-	}
+    complex_t *bfly=T.SCOPE.FFT.bfly;
+    const uint8_t *p1 = T.SCOPE.DC.CH1data;             // Pointer to ch1 data
+    const uint8_t *p2 = T.SCOPE.DC.CH2data;		        // Pointer to ch2 data
+    uint8_t i=0;
+    windowp=FFTWindowTable();                           // Window selected
+	if(!windowp) setbit(Misc, bigfont);		// Temporally use this bit for "no window"
+    do {
+        uint8_t ch1,ch2;
+		uint8_t w=pgm_read_byte_near(windowp);  // Get window data
+		if(testbit(Misc,bigfont)) w=127;        // No window
+		if(i<127) windowp++;                    // Window symmetry
+		if(i>127) windowp--;                    // (only stored half of window)
+        ch1=(int8_t)((*p1++)-128);              // Convert to signed char
+        ch2=(int8_t)((*p2++)-128);              // Convert to signed char
+	    if(testbit(MFFT,iqfft)) {
+            bfly[i].r=FMULS(ch1, w);
+		    bfly[i].i=FMULS(ch2, w);
+        }
+        else {
+            bfly[i].r=(signed int)(FMULS8(ch1, w)*256);
+            bfly[i].i=(signed int)(FMULS8(ch2, w)*256);
+        }
+    } while (++i);
 	clrbit(Misc,bigfont);
-    fft_execute(T.SCOPE.FFT.bfly);
-    fft_output(T.SCOPE.FFT.bfly, T.SCOPE.FFT.magn);
-    // Find maximum frequency
+    fft_execute(bfly);
+    FFTWindowCorrect(bfly);                             // Same tone level with any window
+	if(testbit(MFFT,iqfft)) {
+        fft_output(bfly, T.SCOPE.FFT.magn);
+        return;
+    }
+    // Split the spectra, the FFT output is in bit reversed order.
+    // CH1[k] goes to Z[k], CH2[k] to Z[N-k], CH2[0] to the unused Z[N/2]
+    bfly[1].r=fft_scale(2*(int32_t)bfly[0].i);  bfly[1].i=0;   // Z[N/2] is at 1
+    bfly[0].r=fft_scale(2*(int32_t)bfly[0].r);  bfly[0].i=0;
+    for(i=1; i<FFT_N/2; i++) {
+        uint8_t a=i, b=-i;
+        int16_t ar, ai, br, bi;
+        REVERSE(a); REVERSE(b);
+        ar=bfly[a].r; ai=bfly[a].i;
+        br=bfly[b].r; bi=bfly[b].i;
+        bfly[a].r=fft_scale((int32_t)ar+br);
+        bfly[a].i=fft_scale((int32_t)ai-bi);
+        bfly[b].r=fft_scale((int32_t)ai+bi);
+        bfly[b].i=fft_scale((int32_t)br-ar);
+    }
+    fft_output(bfly, T.SCOPE.FFT.magn);                 // CH1
+    // Move CH2 to where fft_output reads from
+    bfly[0]=bfly[1];
+    for(i=1; i<FFT_N/2; i++) {
+        uint8_t a=i, b=-i;
+        REVERSE(a); REVERSE(b);
+        bfly[a]=bfly[b];
+    }
+    fft_output(bfly, T.SCOPE.FFT.magn+FFT_N/2);         // CH2
+    T.SCOPE.CH1.f=fft_peak(T.SCOPE.FFT.magn);
+    T.SCOPE.CH2.f=fft_peak(T.SCOPE.FFT.magn+FFT_N/2);
+}
+
+// Find maximum frequency
+static uint8_t fft_peak(const uint8_t *m) {
     uint8_t max=3;
     uint8_t i=1;                            // Ignore DC
-    if(T.SCOPE.FFT.magn[0]>T.SCOPE.FFT.magn[1]) i=2;    // Ignore big DC
+    if(m[0]>m[1]) i=2;                      // Ignore big DC
     uint8_t f=0;
     for(; i<FFT_N/2; i++) {
-        uint8_t current=T.SCOPE.FFT.magn[i];
+        uint8_t current=m[i];
         if(current>max) {
             max=current; f=i;
         }
     }
-    if(T.SCOPE.FFT.magn[f]>7) return f;
+    if(m[f]>7) return f;
     else return 0;      // Signal too small
 }
 
@@ -2818,11 +3373,17 @@ static inline void ShowCursorV(void) {
     else delta=M.VcursorB-M.VcursorA;
 
     if(testbit(MFFT, fftmode)) {
-		int8_t fch1,fch2;
+		int16_t fch1,fch2;
         freqv = pgm_read_dword_near(freqval+Srate)/256;
 		if(testbit(MFFT,iqfft)) {
-			fch1=M.VcursorA-M.HPos;
-			fch2=M.VcursorB-M.HPos;
+			fch1=(int8_t)(M.VcursorA-M.HPos);
+			fch2=(int8_t)(M.VcursorB-M.HPos);
+		}
+		else if(FFTDeepOn()) {     // Bins are narrower, and start at FFTFirst
+            if(FFTZoom) freqv = freqv>>FFTZoom;
+            else freqv = freqv>>FFTSize;
+			fch1=M.VcursorA+FFTFirst;
+			fch2=M.VcursorB+FFTFirst;
 		}
 		else {
 			fch1=M.VcursorA;
@@ -2976,6 +3537,7 @@ void Apply(void) {
     // Validate variables
     CheckMax();
     CheckPost();    
+    FFTAccReset();          // Old spectra don't apply
     PMIC.CTRL = 0x04;       // Only high level interrupts
     TCE1.CTRLA = 0;		    // TCE1 controls Interrupt ADC, srate: 6, 7, 8, 9, 10 and fixed value for slow sampling
     TCE1.CTRLB = 0;
@@ -3239,11 +3801,11 @@ ISR(TCC2_LUNF_vect) {
     setbit(Display, trgtimeout);
 }
 
-static void SetupDMACh(DMA_CH_t *ch, uint8_t trigsrc, volatile void *src, volatile void *dest) {
+static void SetupDMACh(DMA_CH_t *ch, uint8_t trigsrc, volatile void *src, volatile void *dest, uint16_t length) {
     setbit(ch->CTRLA, 6);                       // reset channel
     ch->ADDRCTRL  = 0b00000101;                 // src fixed, incr dest, reload dest @ end block
     ch->TRIGSRC   = trigsrc;
-    ch->TRFCNT    = 512;
+    ch->TRFCNT    = length;
     ch->DESTADDR0 = ((uint16_t)dest >> 0) & 0xFF;
     ch->DESTADDR1 = ((uint16_t)dest >> 8) & 0xFF;
     ch->SRCADDR0  = ((uint16_t)src  >> 0) & 0xFF;
@@ -3252,24 +3814,29 @@ static void SetupDMACh(DMA_CH_t *ch, uint8_t trigsrc, volatile void *src, volati
 }
 
 void StartDMAs(void) {
-    SetupDMACh(&DMA.CH0, 0x10, &ADCA.CH0.RESL, T.SCOPE.TempCH1); // ADC CH0 → CH1 buf
+    uint8_t deep=FFTDeepOn();
+    FFTRawLength=FFTCaptureLength();
+    // 512, 1024 point and zoom FFT: one channel only, using both buffers
+    if(deep && !testbit(CH1ctrl,chon)) SetupDMACh(&DMA.CH0, 0x10, &ADCB.CH0.RESL, T.SCOPE.TempCH1, FFTRawLength); // ADC CH1 → CH1 buf
+    else SetupDMACh(&DMA.CH0, 0x10, &ADCA.CH0.RESL, T.SCOPE.TempCH1, FFTRawLength); // ADC CH0 → CH1 buf
     if(testbit(CHDctrl,digchon)) {
         WaitDisplay();                          // Let display finish using DMA
-        SetupDMACh(&DMA.CH2, 0x10, &VPORT2.IN, T.SCOPE.TempCHD); // logic → CHD buf
+        SetupDMACh(&DMA.CH2, 0x10, &VPORT2.IN, T.SCOPE.TempCHD, 512); // logic → CHD buf
     }
-    SetupDMACh(&DMA.CH1, 0x10, &ADCB.CH0.RESL, T.SCOPE.TempCH2); // ADC CH1 → CH2 buf (ADCB trigger has a bug, use 0x10)
+    SetupDMACh(&DMA.CH1, 0x10, &ADCB.CH0.RESL, T.SCOPE.TempCH2, 512); // ADC CH1 → CH2 buf (ADCB trigger has a bug, use 0x10)
     // Start DMAs
     if(testbit(CHDctrl,digchon)) setbit(DMA.CH2.CTRLA, 7);
     setbit(DMA.CH0.CTRLA, 7);           
-    setbit(DMA.CH1.CTRLA, 7);
+    if(!deep) setbit(DMA.CH1.CTRLA, 7);
 
     if(Srate<6) {
         ADCA.CTRLB = 0x1C;  // signed mode, free run, 8 bit
         ADCB.CTRLB = 0x1C;  // signed mode, free run, 8 bit
     }
     else TCE1.CTRLA  = 0x02;        // Enable Timer, Prescaler: clk/2
-    // Minimum time: 128us, Maximum time: 160mS
+    // Minimum time: 128us, Maximum time: 160mS, 640mS with the 1024 point FFT
     uint16_t i=0;
+    uint8_t rounds=FFTRawLength/512;
     while(!testbit(DMA.CH0.CTRLB,4)) {   // Check transfer complete flag (Capture one full buffer of pre-trigger samples)
         _delay_us(3);
         i++;
@@ -3277,7 +3844,7 @@ void StartDMAs(void) {
             clrbit(MStatus,triggered);   // Invalidate data, since the user is interacting
             break;
         }
-        if(i==0) break;     // timeout ~ 197mS
+        if(i==0 && --rounds==0) break;  // timeout ~ 197mS per 512 samples
     }
 }
 
@@ -3287,6 +3854,9 @@ extern NVMVAR EEMEM EEM;
 static inline void LoadEE(void) {
     eeprom_read_block(0, &EEGPIO, 12);
     eeprom_read_block(&M, &EEM, sizeof(NVMVAR));
+    MaskTol=eeprom_read_byte(&EEMaskTol);
+    RefSlot=eeprom_read_byte(&EERefSlot);
+    if(RefSlot>=REF_SLOTS) RefSlot=0;
 }
 
 // Save settings to EEPROM
@@ -3299,6 +3869,8 @@ void SaveEE(void) {
         }
         eeprom_write_block((void *)0, &EEGPIO, 12);     // Copy GPIO
         eeprom_write_block(&M, &EEM, sizeof(NVMVAR));   // Copy M
+        eeprom_write_byte(&EEMaskTol, MaskTol);         // Mask tolerance
+        eeprom_write_byte(&EERefSlot, RefSlot);         // Reference slot
         T.SCOPE.old_s=Srate;
         T.SCOPE.old_g1=M.CH1gain;
         T.SCOPE.old_g2=M.CH2gain;
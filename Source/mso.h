@@ -54,6 +54,23 @@ enum {  // Menu reference:
     MCH2OPER,   // " SUBTRACT \0  MULTIPLY  \0 DERIVATV ", // Operators
     MAWG3,      // "AMPLITUDE \0  DUTY CYCLE \0   OFFSET", // AWG Menu 3
     MSWMODE,    // "  DOWN    \0  PINGPONG   \0   ACCEL ", // Sweep Mode Menu
+    MMAIN6,     // " BODE     \0     MASK   \0          ", // Menu Select 6 - Tools
+    MMASK1,     // " NEW MASK \0  TOLERANCE  \0    TEST ", // Mask test
+    MMASK2,     // " STOP FAIL \0    SOUND   \0   RESET ", // Mask test options
+    MREF,       // " SAVE REF \0    SLOT    \0   REF-CH ", // Reference waveforms
+    MFFTSIZE,   // " 256 PT   \0   512 PT   \0  1024 PT ", // FFT size
+    MFFTAVG,    // " AVERAGE  \0  MAX HOLD  \0  RESTART ", // FFT averaging
+    MTONES,     // " DTMF     \0    50 HZ   \0   60 HZ  ", // Tone detector
+    MWINDOW2,   // " FLAT TOP \0   KAISER   \0    RECT  ", // More windows
+    MFFTVIEW,   // " TRACE    \0  WATERFALL \0   CLEAR  ", // Spectrum display
+    MMARKER,    // " PEAK     \0  NEXT PEAK \0   DELTA  ", // Spectrum markers
+    MXY,        // " PERSIST  \0   PHASE    \0  Z BLANK ", // XY options
+    MAWG7,      // " BUFFER   \0     DDS    \0   BURST  ", // AWG engine
+    MAWG8,      // " AM       \0     FM     \0     PWM  ", // AWG modulation
+    MAWG9,      // " CONTINUE \0    BURST   \0  TRIGGER ", // AWG burst
+    MSWTYPE,    // " LOG      \0    LIST    \0  MARKER  ", // Sweep type
+    MHARM,      // " HARMONIC \0  AMPLITUDE \0   PHASE  ", // Harmonic synthesis
+    MNOISE,     // " WHITE    \0    PINK    \0   BAND   ", // Noise generator
     MUART,                                                 // UART Settings
     MPOSTT,     // "          \0     MOVE-   \0    MOVE+", // Post Trigger  16 bit
     MAWGFREQ,   // "          \0     MOVE-   \0    MOVE+", // Frequency     32 bit
@@ -63,6 +80,15 @@ enum {  // Menu reference:
     MSW1,       // "          \0     MOVE-   \0    MOVE+", // Sweep Start
     MSW2,       // "          \0     MOVE-   \0    MOVE+", // Sweep End
     MHPOS,      // "STOP      \0     MOVE-   \0    MOVE+", // Run/Stop - Horizontal Scroll
+    MMASKTOL,   // "          \0     MOVE-   \0    MOVE+", // Mask tolerance
+    MREFSLOT,   // "          \0     MOVE-   \0    MOVE+", // Reference slot
+    MFFTAVGN,   // "          \0     MOVE-   \0    MOVE+", // Frames averaged
+    MFFTZOOM,   // "          \0     MOVE-   \0    MOVE+", // FFT zoom
+    MMODRATE,   // "          \0     MOVE-   \0    MOVE+", // Modulation rate
+    MMODDEPTH,  // "          \0     MOVE-   \0    MOVE+", // Modulation depth
+    MBURST,     // "          \0     MOVE-   \0    MOVE+", // Burst cycles
+    MHARMAMP,   // "          \0     MOVE-   \0    MOVE+", // Harmonic amplitude
+    MHARMPH,    // "          \0     MOVE-   \0    MOVE+", // Harmonic phase
     // shortcuts below
     MSWSPEED,   // "          \0     MOVE-   \0    MOVE+", // Sweep Speed
     MAWGAMP,    // "          \0     MOVE-   \0    MOVE+", // Amplitude
@@ -89,4 +115,6 @@ void StartDMAs(void);
 void CheckPost(void);               // Check Post Trigger
 void SaveEE(void);                  // Save settings to EEPROM
 
+extern const uint32_t freqval[22];  // Sampling rate * 100000
+
 #endif
@@ -0,0 +1,222 @@
+// Reference waveforms
+// The slots are kept compressed in EEPROM: the layout version, one valid bit
+// per slot, then the records of the valid slots in slot order. A record holds the channels
+// stored, the positions at the time of saving and one compressed trace per
+// stored channel. The active slot is decompressed once into RAM, so drawing
+// the reference doesn't read the EEPROM.
+//
+// Compressed trace: the first sample, then the 255 deltas coded as:
+//   00nnnnnn   n+1 zero deltas
+//   01aaabbb   two deltas, -4..3 each
+//   10dddddd   one delta, -32..31
+//   11nnnnnn   n+1 raw samples follow
+// A raw run only ends where the next two deltas fit in one byte, so a trace
+// never takes more than 260 bytes, and two traces always fit in an empty pool.
+#include <avr/io.h>
+#include <string.h>
+#include "main.h"
+#include "ref.h"
+
+#define REF_HEADER  4   // Channels, CH1 position, CH2 position, Horizontal position
+#define REF_VALID   1   // Pool byte with the valid bit of each slot
+#define REF_RECORDS 2   // First record in the pool
+
+uint8_t RefCtrl;                    // Cached reference contents and options
+uint8_t RefSlot;                    // Active reference slot
+int8_t  RefCH1pos, RefCH2pos;       // Channel positions when the reference was saved
+uint8_t RefHPos;                    // Horizontal position when the reference was saved
+uint16_t RefUsed;                   // Bytes used in the pool
+
+static void ReadPool(void);
+static uint8_t *Walk(uint8_t slots);
+static uint8_t *Skip(uint8_t *p);
+static uint8_t *Pack(const uint8_t *s, uint8_t *out, const uint8_t *end);
+static uint8_t *Unpack(uint8_t *in, uint8_t *s);
+
+// Decompress a slot into the RAM cache, returns 0 if the slot is empty
+uint8_t RefLoad(uint8_t slot) {
+    uint8_t *p, ch;
+    RefCtrl &= ~((1<<refch1) | (1<<refch2) | (1<<reffull));
+    ReadPool();
+    if(!testbit(T.SCOPE.REF.pool[REF_VALID], slot)) return 0;
+    p=Walk(slot);
+    ch=*p++;
+    RefCH1pos=*p++;
+    RefCH2pos=*p++;
+    RefHPos=*p++;
+    if(testbit(ch,refch1)) p=Unpack(p, T.SCOPE.REF.ch1);
+    if(testbit(ch,refch2)) p=Unpack(p, T.SCOPE.REF.ch2);
+    RefCtrl |= ch & ((1<<refch1) | (1<<refch2));
+    return 1;
+}
+
+// Compress the channels that are on into a slot, replacing its old contents.
+// With both channels off the slot is erased. Returns 0 if the pool is full,
+// in which case the EEPROM is not modified.
+uint8_t RefSave(uint8_t slot) {
+    uint8_t *pool=T.SCOPE.REF.pool, *s, *p, *end, ch=0;
+    uint16_t tail;
+    setbit(RefCtrl, reffull);
+    ReadPool();
+    s=Walk(slot);
+    p=s;
+    if(testbit(pool[REF_VALID], slot)) p=Skip(s);
+    // Move the following slots to the end of the image, out of the way
+    tail=(pool+RefUsed)-p;
+    end=pool+REF_POOL-tail;
+    memmove(end, p, tail);
+    clrbit(pool[REF_VALID], slot);
+    if(testbit(CH1ctrl,chon)) setbit(ch,refch1);
+    if(testbit(CH2ctrl,chon)) setbit(ch,refch2);
+    p=s;
+    if(ch) {
+        if(p+REF_HEADER>end) return 0;
+        *p++=ch;
+        *p++=M.CH1pos;
+        *p++=M.CH2pos;
+        *p++=M.HPos;
+        if(testbit(ch,refch1)) p=Pack(T.SCOPE.DC.CH1data, p, end);
+        if(testbit(ch,refch2) && p) p=Pack(T.SCOPE.DC.CH2data, p, end);
+        if(p==0) return 0;
+        setbit(pool[REF_VALID], slot);
+    }
+    memmove(p, end, tail);
+    RefUsed=(p+tail)-pool;
+    eeprom_update_block(pool, EEREF, RefUsed);   // Only the changed bytes are written
+    // Update the cache
+    memcpy(T.SCOPE.REF.ch1, T.SCOPE.DC.CH1data, 256);
+    memcpy(T.SCOPE.REF.ch2, T.SCOPE.DC.CH2data, 256);
+    RefCH1pos=M.CH1pos;
+    RefCH2pos=M.CH2pos;
+    RefHPos=M.HPos;
+    RefCtrl = (RefCtrl & ~((1<<refch1) | (1<<refch2) | (1<<reffull))) | ch;
+    return 1;
+}
+
+// Copy the pool to RAM, and check it
+static void ReadPool(void) {
+    uint8_t *pool=T.SCOPE.REF.pool, *p;
+    eeprom_read_block(pool, EEREF, REF_POOL);
+    // The older firmware kept two raw traces here, with no marker to tell
+    // them from an erased EEPROM, so any other layout is cleared
+    if(pool[0]!=REF_LAYOUT) {
+        pool[0]=REF_LAYOUT;
+        pool[REF_VALID]=0;
+        eeprom_update_block(pool, EEREF, REF_RECORDS);
+    }
+    pool[REF_VALID] &= (1<<REF_SLOTS)-1;
+    p=Walk(REF_SLOTS);
+    if(p==0) {      // Corrupted, start over
+        pool[REF_VALID]=0;
+        p=pool+REF_RECORDS;
+    }
+    RefUsed=p-T.SCOPE.REF.pool;
+}
+
+// Find where the record of a slot starts, returns 0 if the pool is corrupted
+static uint8_t *Walk(uint8_t slots) {
+    uint8_t *p=T.SCOPE.REF.pool+REF_RECORDS;
+    for(uint8_t k=0; k<slots && p; k++) {
+        if(testbit(T.SCOPE.REF.pool[REF_VALID], k)) p=Skip(p);
+    }
+    return p;
+}
+
+// Skip a record, returns 0 if it runs past the end of the pool
+static uint8_t *Skip(uint8_t *p) {
+    uint8_t ch;
+    if(p+REF_HEADER>T.SCOPE.REF.pool+REF_POOL) return 0;
+    ch=*p;
+    p+=REF_HEADER;
+    if(testbit(ch,refch1)) p=Unpack(p, 0);
+    if(testbit(ch,refch2) && p) p=Unpack(p, 0);
+    return p;
+}
+
+// Compress a trace, returns the next output byte, 0 if it doesn't fit
+static uint8_t *Pack(const uint8_t *s, uint8_t *out, const uint8_t *end) {
+    uint16_t i=1;
+    uint8_t n, pair, *code;
+    int16_t d, d2;
+    if(out>=end) return 0;
+    *out++=s[0];
+    while(i<256) {
+        if(out>=end) return 0;
+        d=s[i]-s[i-1];
+        if(d==0) {                  // Zero deltas
+            n=0;
+            while(i+n<255 && n<63 && s[i+n+1]==s[i+n]) n++;
+            *out++=n;
+            i+=n+1;
+        }
+        else if(d>=-4 && d<=3 && i<255 && (d2=s[i+1]-s[i])>=-4 && d2<=3) {   // Two small deltas
+            *out++=0x40 | ((d&7)<<3) | (d2&7);
+            i+=2;
+        }
+        else if(d>=-32 && d<=31) {  // One delta
+            *out++=0x80 | (d&0x3F);
+            i++;
+        }
+        else {                      // Raw samples, until the next two deltas fit in one byte
+            code=out++;
+            n=0;
+            do {
+                if(out>=end) return 0;
+                *out++=s[i++];
+                n++;
+                pair=0;             // The last sample costs a byte either way
+                if(i<255) {
+                    d=s[i]-s[i-1];
+                    d2=s[i+1]-s[i];
+                    if(d==0) pair=(d2==0);      // A single zero delta is coded alone
+                    else pair=(d>=-4 && d<=3 && d2>=-4 && d2<=3);
+                }
+            } while(i<256 && n<64 && !pair);
+            *code=0xC0 | (n-1);
+        }
+    }
+    return out;
+}
+
+// Decompress a trace into s, or only skip it if s is 0
+// Returns the next input byte, 0 if the trace runs past the end of the pool
+static uint8_t *Unpack(uint8_t *in, uint8_t *s) {
+    const uint8_t *end=T.SCOPE.REF.pool+REF_POOL;
+    uint16_t i=1;
+    uint8_t c, n, v;
+    if(in>=end) return 0;
+    v=*in++;
+    if(s) *s++=v;
+    while(i<256) {
+        if(in>=end) return 0;
+        c=*in++;
+        n=(c&0x3F)+1;
+        if(c<0x40) {                // Zero deltas
+            if(i+n>256) return 0;
+            i+=n;
+            if(s) while(n--) *s++=v;
+        }
+        else if(c<0x80) {           // Two small deltas
+            if(i+2>256) return 0;
+            i+=2;
+            v+=(int8_t)(c<<2)>>5;
+            if(s) *s++=v;
+            v+=(int8_t)(c<<5)>>5;
+            if(s) *s++=v;
+        }
+        else if(c<0xC0) {           // One delta
+            i++;
+            v+=(int8_t)(c<<2)>>2;
+            if(s) *s++=v;
+        }
+        else {                      // Raw samples
+            if(i+n>256 || in+n>end) return 0;
+            i+=n;
+            while(n--) {
+                v=*in++;
+                if(s) *s++=v;
+            }
+        }
+    }
+    return in;
+}
@@ -0,0 +1,27 @@
+#ifndef _REF_H
+#define _REF_H
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+
+// RefCtrl bits
+#define refch1      0       // Cached reference has CH1
+#define refch2      1       // Cached reference has CH2
+#define reffull     6       // Last save didn't fit
+#define refmath     7       // Show REF-CH instead of the reference
+
+#define REF_LAYOUT  0x52    // First pool byte, changes with the pool format
+
+extern uint8_t RefCtrl;             // Cached reference contents and options
+extern uint8_t RefSlot;             // Active reference slot
+extern int8_t  RefCH1pos;           // CH1 position when the reference was saved
+extern int8_t  RefCH2pos;           // CH2 position when the reference was saved
+extern uint8_t RefHPos;             // Horizontal position when the reference was saved
+extern uint16_t RefUsed;            // Bytes used in the pool, after the last load or save
+extern uint8_t EEMEM EEREF[REF_POOL];   // Reference waveforms, compressed
+extern uint8_t EEMEM EERefSlot;     // Active reference slot
+
+uint8_t RefLoad(uint8_t slot);      // Decompress a slot into the RAM cache
+uint8_t RefSave(uint8_t slot);      // Compress the current trace into a slot
+
+#endif
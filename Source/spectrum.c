@@ -0,0 +1,856 @@
+// 512 and 1024 point FFT of one channel
+// The capture goes straight from the ADC to TempCH1, up to 2048 bytes. The N
+// real samples are packed as N/2 complex samples z[m] = x[2m] + jx[2m+1],
+// transformed with the 256 point FFT, and separated with:
+//   X[k] = (Z[k] + Z*[M-k])/2 - jW^k (Z[k] - Z*[M-k])/2       M = N/2, W = e^(-j2pi/N)
+// For N=1024, Z is built from the FFTs of the even and the odd z:
+//   Z[k] = (E[k] + W^2k O[k])/2
+// Only the 128 bins on the display are computed, starting at FFTFirst.
+//
+// Zoom FFT: the capture is mixed down with an NCO at the center frequency,
+// set with the horizontal position, filtered with a second order CIC and
+// decimated. The 256 point complex FFT of the result shows 128 bins around
+// the center, zoom times narrower than the 256 point bins. The capture is
+// at most 2048 samples, at the higher zooms fewer than 256 decimated samples
+// fit and the rest is zero padded, the bins are still narrower but the
+// resolution stops improving.
+//
+// The spectrum is scaled by the inverse of the coherent gain of the window,
+// so a tone reads the same amplitude with any window.
+//
+// Waterfall: one spectrum per column, newest on the right, the frequency goes
+// up. The level is dithered to on and off pixels. The display buffer is not
+// cleared and not double buffered: each new spectrum is written over the
+// oldest line of the buffer and the LCD line addresses are rotated, so only
+// one line is drawn per frame. The bytes of the menu line are moved the other
+// way, to keep the menu in place.
+//
+// Marker: follows the local maximum it was put on. The levels of the peak bin
+// and its neighbors are converted to log2 of the magnitude and a parabola is
+// fitted to them, its vertex gives the frequency to a fraction of a bin and
+// the level of a tone between bins. The level is shown in dBV rms:
+//   20log10(b) - 20log10(179.6) + 20log10(0.16V) - 3dB - 6dB*gain (+20dB x10)
+//   = 20log10(b) - 64dB - 6dB*gain (+20dB x10)
+// where b = 179.6 * the amplitude in samples, before the conversion to magn,
+// and 0.16V is one sample at gain 0, 5.12V/div over 32 samples (20log10(0.16) = -15.9dB).
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "main.h"
+#include "mso.h"
+#include "spectrum.h"
+
+uint8_t  FFTSize;                   // Number of points
+uint8_t  FFTWindow;                 // Flat top or Kaiser, otherwise the MFFT window bits apply
+uint8_t  FFTZoom;                   // Zoom around the center frequency, log2 of the zoom, 0 is off
+uint16_t FFTFirst;                  // First bin on the display
+uint16_t FFTRawLength=512;          // Size of the capture buffer used by the last capture
+uint16_t FFTCircular;               // Oldest sample in the capture buffer
+uint8_t  FFTCtrl=2;                 // Averaging, max hold and distortion options, 4 frames
+uint8_t  FFTFrames;                 // Frames accumulated
+static uint16_t *AccLast;           // Accumulators used on the last frame
+static uint16_t AccFirst;           // First bin on the last frame
+static uint8_t  AccMFFT, AccFrame;  // Settings and frame number on the last frame
+
+// 16*(Log2(1) thru Log2(2)), same as in fft_output
+// Window amplitude correction = 256 / coherent gain, the tables peak at 127
+// Equivalent noise bandwidth, in bins: 1.0, 1.377, 1.514, 1.745, 3.782, 1.672
+static const uint16_t WinCorr[6] PROGMEM = { 256, 477, 514, 612, 1192, 590 };
+// Half width of the main lobe and the first side lobe, in bins
+static const uint8_t WinLobe[6] PROGMEM = { 3, 3, 3, 4, 6, 4 };
+static uint16_t Gain;               // Window correction of the spectrum being converted
+
+static uint8_t *WaterBuf;           // Display buffer used by the waterfall, 0 if off
+static uint8_t  WaterLine;          // Buffer line of the newest spectrum
+static uint8_t  WaterFrame;         // Last frame added
+// 4x4 ordered dither thresholds, for levels 0 to 2*(WATER_BINS-1)
+static const uint8_t Dither[16] PROGMEM = { 7,127,37,157, 187,67,217,97, 52,172,22,142, 232,112,202,82 };
+
+static const uint8_t Log2Table[16] PROGMEM = { 0,2,3,4,5,6,7,8,9,10,11,12,13,14,14,15 };
+// Inverse of Log2Table: middle of the mantissas of each step * 32768, 1 never occurs
+static const uint16_t Exp2Table[16] PROGMEM = {
+    33792, 34219, 35840, 37888, 39936, 41984, 44032, 46080, 48128, 50176, 52224, 54272, 56320, 58368, 61440, 64512
+};
+
+DISTORTION Dist;                    // Last distortion analysis
+
+uint8_t  ToneCtrl;                  // Tone detector frequency set
+uint16_t ToneLevel[TONES];          // log2 of the power * 256, 0 if not measured
+static char    ToneText[24];        // Decoded DTMF digits, newest on the right
+static uint8_t ToneFrame;           // Last frame tested
+static char    ToneDigit;           // Digit on the last frame, 0 if none
+
+typedef struct {
+    int32_t f;                  // Frequency, same units as freqval
+    int16_t db;                 // Level, dBV*10
+} MARKER;
+
+uint8_t MarkerCtrl;                 // Marker options and pending searches
+static uint8_t MarkerX;             // Display column of the marker
+static uint8_t MarkerY;             // Top of the trace at the marker
+static MARKER  Marker, MarkerRef;   // Interpolated peak, and the delta reference
+
+// DTMF rows, then columns
+static const uint16_t DTMFFreq[TONES] PROGMEM = { 697, 770, 852, 941, 1209, 1336, 1477, 1633 };
+static const char DTMFKeys[16] PROGMEM = "123A456B789C*0#D";
+
+// log2(1+i/32) * 256
+static const uint8_t Log2Frac[32] PROGMEM = {
+      0,  11,  22,  33,  44,  54,  63,  73,  82,  92, 100, 109, 118, 126, 134, 142,
+    150, 157, 165, 172, 179, 186, 193, 200, 207, 213, 220, 226, 232, 238, 244, 250
+};
+
+static uint8_t WindowIndex(void);
+static void Zoom(void);
+static uint8_t ZoomShift(void);
+static uint16_t Goertzel(const uint8_t *data, int8_t mean, uint16_t f, uint32_t fs);
+static int16_t SinN(uint16_t a);
+static void Bin(complex_t *z, uint16_t k);
+static uint8_t Magnitude(int32_t r, int32_t i);
+static uint8_t MagnScale(uint16_t b);
+static uint16_t MagnAmplitude(uint8_t v);
+static uint16_t Sqrt(uint32_t v);
+static uint32_t Power(uint8_t k);
+static uint32_t Lobe(uint8_t *used, uint8_t k, uint8_t w);
+static uint32_t Skirt(uint8_t *used, uint8_t k, int8_t step);
+static uint8_t FreeBins(const uint8_t *used);
+static int16_t dB10(uint32_t num, uint32_t den);
+static int16_t Log2(uint32_t x);
+static void RowRotate(uint8_t k);
+static void WaterScroll(void);
+static int16_t MarkerBin(uint8_t first, uint8_t x);
+static int16_t MarkerLevel(const uint8_t *magn, uint8_t first, uint8_t x);
+static void RowReverse(uint8_t a, uint8_t b);
+
+// Only in FFT mode with real data, at the sampling rates captured by the DMA
+uint8_t FFTDeepOn(void) {
+    return (FFTSize || FFTZoom) && Srate<11 && testbit(MFFT,fftmode) && !testbit(MFFT,iqfft);
+}
+
+uint16_t FFTCaptureLength(void) {
+    uint16_t n;
+    if(!FFTDeepOn()) return 512;
+    if(FFTZoom) {                   // One extra decimated sample for the filter to settle
+        n=(FFT_N+1)<<ZoomShift();
+        if(n>2048) n=2048;
+        return n;
+    }
+    n=FFT_N<<FFTSize;
+    if(Srate) n=n<<1;               // Oversample is x2 at Srate 1 and above
+    return n;
+}
+
+// First half of the window selected, 0 for the rectangular window
+const int8_t *FFTWindowTable(void) {
+    if(FFTWindow==WIN_FLATTOP) return FlatTop;
+    if(FFTWindow==WIN_KAISER) return Kaiser;
+    if(testbit(MFFT, hamming)) return Hamming;
+    if(testbit(MFFT, hann)) return Hann;
+    if(testbit(MFFT, blackman)) return Blackman;
+    return 0;
+}
+
+// Scale the 256 point FFT output so a tone reads the same with any window
+void FFTWindowCorrect(complex_t *bfly) {
+    uint16_t g=pgm_read_word_near(WinCorr+WindowIndex());
+    uint8_t i=0;
+    if(g==256) return;
+    do {
+        int32_t r=((int32_t)bfly->r*g)>>8, im=((int32_t)bfly->i*g)>>8;
+        if(r>32767) r=32767;
+        if(r<-32767) r=-32767;
+        if(im>32767) im=32767;
+        if(im<-32767) im=-32767;
+        bfly->r=r; bfly->i=im;
+        bfly++;
+    } while(++i);
+}
+
+// Spectrum of the last capture, 128 bins to T.SCOPE.FFTD.magn
+void FFTDeep(void) {
+    complex_t *bfly=T.SCOPE.FFTD.bfly;
+    const int8_t *windowp=0;
+    const int8_t *raw=T.SCOPE.TempCH1;
+    uint16_t n, N=FFT_N<<FFTSize, half=N/2, c=FFTCircular;
+    if(FFTRawLength!=FFTCaptureLength()) {  // Settings changed since the capture
+        for(uint8_t i=0; i<FFT_N/2; i++) T.SCOPE.FFTD.magn[i]=0;
+        return;
+    }
+    if(FFTZoom) {
+        Zoom();
+        return;
+    }
+    windowp=FFTWindowTable();
+    Gain=pgm_read_word_near(WinCorr+WindowIndex());
+    for(n=0; n<N; n++) {
+        uint16_t m=n>>1, p=m;
+        uint8_t j=n>>FFTSize;           // Window index, the tables have 256 steps
+        int8_t w=127;
+        int16_t x;
+        if(windowp) w=pgm_read_byte_near(windowp+(j<128 ? j : 255-j));
+        x=raw[c];
+        if(++c>=FFTRawLength) c=0;
+        if(Srate) {                     // Decimate the x2 oversampling
+            x+=raw[c];
+            if(++c>=FFTRawLength) c=0;
+        }
+        else x=x*2;
+        x=x*w;
+        if(FFTSize==FFT_1024) p=((m&1)<<8)+(m>>1);     // Even z first, then odd z
+        if(n&1) bfly[p].i=x;
+        else bfly[p].r=x;
+    }
+    fft_execute(bfly);
+    if(FFTSize==FFT_1024) fft_execute(bfly+FFT_N);
+    FFTFirst=(uint16_t)M.HPos<<(FFTSize-1);
+    if(FFTFirst>half-FFT_N/2) FFTFirst=half-FFT_N/2;
+    for(uint8_t i=0; i<FFT_N/2; i++) {
+        complex_t a, b;
+        int32_t ar, ai, br, bi, xr, xi;
+        int16_t s, co;
+        uint16_t k=FFTFirst+i;
+        Bin(&a, k);
+        Bin(&b, (half-k)&(half-1));
+        ar=(int32_t)a.r+b.r; ai=(int32_t)a.i-b.i;
+        br=(int32_t)a.r-b.r; bi=(int32_t)a.i+b.i;
+        k=k<<(FFT_1024-FFTSize);        // Angle in 1024 steps
+        s=SinN(k); co=SinN(k+256);
+        xr=ar-((s*br)>>15)+((co*bi)>>15);
+        xi=ai-((co*br)>>15)-((s*bi)>>15);
+        // Scale to match the 256 point spectrum
+        T.SCOPE.FFTD.magn[i]=Magnitude((xr*181)>>9, (xi*181)>>9);
+    }
+}
+
+// Average or max hold across frames. The averages are of the power: each
+// magnitude shown is taken back to the amplitude in the middle of its step
+// and squared, and the average is shown on the display scale again. The
+// accumulators hold the rms amplitude, in the units of Magnitude before the
+// scaling to magn, or the maximum of magn. The result replaces magn.
+// Returns 0 if not enabled.
+uint8_t FFTAccumulate(uint8_t *magn, uint16_t *acc, uint16_t n) {
+    uint8_t k=FFTCtrl&fftavgn, N=1<<k, add;
+    if(!(FFTCtrl&((1<<fftavg)|(1<<fftmax)))) return 0;
+    // Different bins or scale
+    if(acc!=AccLast || FFTFirst!=AccFirst || MFFT!=AccMFFT) FFTAccReset();
+    AccLast=acc; AccFirst=FFTFirst; AccMFFT=MFFT;
+    add=(T.SCOPE.DC.frame!=AccFrame);  // Only add each frame once
+    AccFrame=T.SCOPE.DC.frame;
+    if(!testbit(FFTCtrl,fftmax) && !testbit(FFTCtrl,fftexp) && FFTFrames>=N) add=0;  // Linear average complete
+    for(uint16_t i=0; i<n; i++) {
+        uint8_t m=magn[i];
+        uint16_t a=acc[i];
+        if(testbit(FFTCtrl,fftmax)) {
+            if(add && (FFTFrames==0 || m>a)) a=m;
+            magn[i]=a;
+        }
+        else {
+            if(add) {
+                uint16_t b=MagnAmplitude(m);
+                if(FFTFrames==0) a=b;
+                else {
+                    uint32_t p=(uint32_t)b*b, s=(uint32_t)a*a, d;
+                    if(p>=s) d=p-s;
+                    else d=s-p;
+                    if(testbit(FFTCtrl,fftexp)) d=d>>k;         // Exponential
+                    else d=d/(FFTFrames+1);                     // Linear, running mean
+                    if(p>=s) s+=d;
+                    else s-=d;
+                    a=Sqrt(s);
+                    if(s-(uint32_t)a*a>a) a++;                  // Round
+                }
+            }
+            magn[i]=MagnScale(a);
+        }
+        acc[i]=a;
+    }
+    if(add && FFTFrames<255) FFTFrames++;
+    return 1;
+}
+
+void FFTAccReset(void) {
+    FFTFrames=0;
+    AccFrame=T.SCOPE.DC.frame-1;
+}
+
+// Distortion analysis of one channel, 256 samples
+// The fundamental is the largest bin, its power and the power of the
+// harmonics are summed over the main lobe of the window, so the window
+// leakage is counted with the tone and not as noise. The skirt of the tone
+// past its lobe is added to it while it keeps falling. The harmonics above
+// Nyquist fold back, the ones that land on DC or on the tone are skipped.
+// The noise is the rest of the bins, scaled up to the whole band to replace
+// the bins taken by DC, the tone and the harmonics.
+void Distortion(const uint8_t *data) {
+    complex_t *bfly=T.SCOPE.FFTD.bfly;  // Free during the display in both FFT sizes
+    const int8_t *windowp=0;
+    uint8_t used[FFT_N/16], w, k, k0=0, i=0, n, nt;
+    uint32_t p, pmax=0, pf, ph=0, pn=0;
+    int32_t moment=0, sum=0;
+    uint16_t f0;
+    windowp=FFTWindowTable();
+    w=pgm_read_byte_near(WinLobe+WindowIndex());
+    do {
+        int8_t win=127;
+        if(windowp) win=pgm_read_byte_near(windowp+(i<128 ? i : 255-i));
+        bfly[i].r=FMULS((int8_t)(data[i]-128), win);
+        bfly[i].i=0;
+    } while(++i);
+    fft_execute(bfly);
+    for(i=0; i<FFT_N/16; i++) used[i]=0;
+    Lobe(used, 0, w);                   // Remove DC
+    for(k=w+1; k<FFT_N/2; k++) {        // Fundamental
+        p=Power(k);
+        if(p>pmax) { pmax=p; k0=k; }
+    }
+    Dist.bin=0;
+    if(pmax<16) return;                 // No signal
+    // Fundamental frequency in 1/256 bins, from the centroid of the lobe
+    for(k=k0-w; k<=k0+w && k<FFT_N/2; k++) {
+        p=Power(k)>>12;
+        moment+=(int8_t)(k-k0)*(int32_t)p;
+        sum+=p;
+    }
+    f0=k0<<8;
+    if(sum) f0+=(moment<<8)/sum;
+    pf=Lobe(used, k0, w);
+    nt=FreeBins(used);                  // Bins left after DC and the tone
+    // Harmonics, while enough bins are left to measure the noise
+    for(uint8_t h=2; h<=9 && FreeBins(used)>=FFT_N/8; h++) {
+        uint16_t kh=(((uint32_t)f0*h+128)>>8)%FFT_N;
+        if(kh>=FFT_N/2) kh=FFT_N-kh;    // Alias
+        // Not inside the lobe of DC or of the tone, it would only measure their leakage
+        if(kh>=FFT_N/2 || kh<=w || (kh+w>=k0 && kh<=k0+w)) continue;
+        ph+=Lobe(used, kh, w);
+    }
+    nt-=FreeBins(used);                 // Bins taken by the harmonics
+    pf+=Skirt(used, k0+w, 1);           // Leakage of the tone, up to the harmonics
+    if(k0>w) pf+=Skirt(used, k0-w, -1);
+    for(k=0; k<FFT_N/2; k++) {          // Noise
+        if(!testbit(used[k>>3], k&7)) pn+=Power(k);
+    }
+    n=FreeBins(used);
+    if(n) {
+        pn=pn/n;                        // Noise per bin
+        p=pn*nt;                        // Noise in the harmonics bins only
+        if(ph>p+pn) ph-=p;              // Take the noise out of the harmonics
+        else ph=pn;                     // Below the noise, one bin of noise
+        pn=pn*(FFT_N/2-1-w);            // Noise in the whole band
+    }
+    Dist.thd=dB10(ph, pf);
+    Dist.snr=dB10(pf, pn);
+    Dist.sinad=dB10(pf, pn+ph);
+    Dist.enob=((int32_t)Dist.sinad*10-176)*10/602;  // (SINAD-1.76)/6.02
+    Dist.bin=k0;
+}
+
+// Show the distortion analysis
+void DistDraw(void) {
+    if(Dist.bin==0) {
+        tiny_printp(0,2,PSTR("NO SIGNAL"));
+        return;
+    }
+    tiny_printp(0,2,PSTR("THD"));   printF(20,2,(int32_t)Dist.thd*10000);   print3x6(PSTR("DB"));
+    tiny_printp(0,3,PSTR("SNR"));   printF(20,3,(int32_t)Dist.snr*10000);   print3x6(PSTR("DB"));
+    tiny_printp(0,4,PSTR("SINAD")); printF(20,4,(int32_t)Dist.sinad*10000); print3x6(PSTR("DB"));
+    tiny_printp(0,5,PSTR("ENOB"));  printF(20,5,(int32_t)Dist.enob*10000);
+}
+
+// Goertzel detectors on CH1, only the frequencies watched are evaluated.
+// DTMF: a digit is decoded when the strongest row and column tones are above
+// the minimum level, at least 6dB over the other tones of their group and
+// within 8dB of each other. Each new digit is added once.
+void ToneTest(void) {
+    const uint8_t *data=T.SCOPE.DC.CH1data;
+    uint32_t fs;
+    int16_t sum=0;
+    uint8_t i=0, row=0, col=4;
+    char digit=0;
+    if(T.SCOPE.DC.frame==ToneFrame) return;     // Already tested
+    ToneFrame=T.SCOPE.DC.frame;
+    fs=pgm_read_dword_near(freqval+Srate);
+    if(Srate>=7) fs/=1000;              // Sampling rate, Hz*100
+    do { sum+=data[i]-128; } while(++i);
+    for(i=0; i<TONES; i++) {
+        uint16_t f;
+        if(ToneCtrl==TONE_DTMF) f=pgm_read_word_near(DTMFFreq+i);
+        else f=(ToneCtrl==TONE_50HZ ? 50 : 60)*(i+1);
+        ToneLevel[i]=Goertzel(data, sum>>8, f, fs);
+    }
+    if(ToneCtrl!=TONE_DTMF) return;
+    for(i=1; i<4; i++) {
+        if(ToneLevel[i]>ToneLevel[row]) row=i;
+        if(ToneLevel[i+4]>ToneLevel[col]) col=i+4;
+    }
+    if(ToneLevel[row]>=TONE_MIN && ToneLevel[col]>=TONE_MIN &&
+       ToneLevel[row]<ToneLevel[col]+TONE_TWIST && ToneLevel[col]<ToneLevel[row]+TONE_TWIST) {
+        digit=pgm_read_byte_near(DTMFKeys+row*4+col-4);
+        for(i=0; i<4; i++) {
+            if(i!=row && ToneLevel[i]+TONE_MARGIN>ToneLevel[row]) digit=0;
+            if(i+4!=col && ToneLevel[i+4]+TONE_MARGIN>ToneLevel[col]) digit=0;
+        }
+    }
+    if(digit && digit!=ToneDigit) {     // Scroll left, add the new digit
+        for(i=0; i<sizeof(ToneText)-2; i++) ToneText[i]=ToneText[i+1];
+        ToneText[sizeof(ToneText)-2]=digit;
+    }
+    ToneDigit=digit;
+}
+
+// Show the tone levels as bars, 1.5dB per pixel over 1 sample of amplitude,
+// and the decoded DTMF digits
+void ToneDraw(void) {
+    for(uint8_t i=0; i<TONES; i++) {
+        uint8_t x=100+i*3, h=0;
+        if(ToneLevel[i]>TONE_1LSB) h=(ToneLevel[i]-TONE_1LSB)>>7;
+        if(h>24) h=24;
+        set_line(x, 40, x, 40-h);
+        set_line(x+1, 40, x+1, 40-h);
+    }
+    if(ToneCtrl==TONE_DTMF) {
+        lcd_goto(0,2);
+        for(uint8_t i=0; i<sizeof(ToneText)-1; i++) {
+            if(ToneText[i]) putchar3x6(ToneText[i]);
+        }
+    }
+    else if(ToneCtrl==TONE_50HZ) tiny_printp(100,6,PSTR("50HZ"));
+    else tiny_printp(100,6,PSTR("60HZ"));
+}
+
+void ToneReset(void) {
+    for(uint8_t i=0; i<sizeof(ToneText); i++) ToneText[i]=0;
+    ToneDigit=0;
+    ToneFrame=T.SCOPE.DC.frame-1;
+}
+
+uint8_t WaterfallActive(void) {
+    return WaterBuf!=0;
+}
+
+// Only in FFT mode alone, at the sampling rates captured by the DMA
+void WaterfallCheck(void) {
+    uint8_t on=testbit(FFTCtrl,fftwater) && testbit(MFFT,fftmode) &&
+               !testbit(MFFT,scopemode) && !testbit(MFFT,xymode) && Srate<11;
+    if(on && !WaterBuf) {
+        WaitDisplay();
+        WaterBuf=Disp_send.SPI_Address;     // Keep the buffer being drawn
+        WaterLine=0;                        // The addresses are not rotated
+        WaterFrame=T.SCOPE.DC.frame-1;
+        clr_display();
+        setbit(MStatus, update);            // Draw the menu again
+    }
+    if(!on) WaterfallStop();
+}
+
+// Restore the line addresses, the display goes back to the spectrum
+void WaterfallStop(void) {
+    if(!WaterBuf) return;
+    WaitDisplay();
+    LCD_LineAddresses(WaterBuf, 0);
+    WaterBuf=0;
+    setbit(Misc, redraw);
+}
+
+// New spectrum, bins first to first+WATER_BINS-1 of magn, shift scales the
+// level like the trace: WATER_BINS-1 is full intensity
+void WaterfallLine(const uint8_t *magn, uint8_t first, uint8_t shift) {
+    uint8_t *p, k=WATER_BINS-1, y=0;
+    const uint8_t *d;
+    if(T.SCOPE.DC.frame==WaterFrame) return;    // Stopped, nothing new
+    WaterFrame=T.SCOPE.DC.frame;
+    WaterLine=(WaterLine-1)&127;        // The oldest line is reused
+    p=WaterBuf+2+(uint16_t)WaterLine*DISPLAY_BYTES_IN_ROW;
+    d=Dither+(WaterLine&3);
+    for(uint8_t b=0; b<WATER_BINS/8; b++) {
+        uint8_t ink=0;
+        for(uint8_t bit=0x80; bit; bit>>=1) {
+            uint8_t level=magn[(uint8_t)(first+k)]>>shift;
+            if(level>WATER_BINS-1) level=WATER_BINS-1;
+            if(level*2>pgm_read_byte_near(d+((y&3)<<2))) ink|=bit;
+            k--; y++;
+        }
+        #ifdef INVERT_DISPLAY
+        *p++=~ink;
+        #else
+        *p++=ink;
+        #endif
+    }
+    WaterScroll();
+}
+
+// Move the menu line just drawn to the rotated lines
+void WaterfallOverlay(void) {
+    RowRotate((-WaterLine)&127);
+}
+
+// Follow the peak on a new spectrum, bins first to first+127 of magn. Shift
+// and base locate the trace like on the display.
+void MarkerUpdate(const uint8_t *magn, uint8_t first, uint8_t shift, uint8_t base) {
+    uint8_t x=MarkerX, gain=M.CH1gain, ctrl=CH1ctrl, v;
+    int16_t a, b, c, p=0;
+    uint32_t freqv=pgm_read_dword_near(freqval+Srate)/256;
+    if(MarkerCtrl & ((1<<mkpeak) | (1<<mknext))) {
+        // Highest local maximum, below the current one for the next peak, not DC
+        uint16_t top=256;
+        uint8_t best=0;
+        if(testbit(MarkerCtrl,mknext)) top=magn[(uint8_t)(first+x)];
+        else x=0;
+        for(uint8_t i=1; i<127; i++) {
+            v=magn[(uint8_t)(first+i)];
+            if(v<=magn[(uint8_t)(first+i-1)] || v<magn[(uint8_t)(first+i+1)]) continue;
+            if(v>best && v<top && MarkerBin(first,i)!=0) {
+                best=v;
+                x=i;
+            }
+        }
+        MarkerCtrl &= ~((1<<mkpeak) | (1<<mknext));
+    }
+    // Climb to the local maximum, the tone may have moved
+    while(x>0 && magn[(uint8_t)(first+x-1)]>magn[(uint8_t)(first+x)]) x--;
+    while(x<127 && magn[(uint8_t)(first+x+1)]>magn[(uint8_t)(first+x)]) x++;
+    MarkerX=x;
+    v=magn[(uint8_t)(first+x)]>>shift;
+    if(v>base) v=base;
+    MarkerY=base-v;
+    b=MarkerLevel(magn, first, x);
+    if(x>0 && x<127) {                  // Vertex of the parabola, p in 1/256 bins
+        int16_t den;
+        a=MarkerLevel(magn, first, x-1);
+        c=MarkerLevel(magn, first, x+1);
+        den=a-2*b+c;
+        if(den<0) {
+            p=((int32_t)(a-c)<<7)/den;
+            if(p>128) p=128;
+            if(p<-128) p=-128;
+            b-=((int32_t)(a-c)*p)>>10;
+        }
+    }
+    if(!testbit(MFFT,iqfft) && FFTDeepOn()) freqv=freqv>>(FFTZoom ? FFTZoom : FFTSize);
+    Marker.f=(int32_t)MarkerBin(first,x)*freqv+(((int32_t)p*(int32_t)freqv)>>8);
+    if(!testbit(MFFT,iqfft) && !FFTDeepOn() && !testbit(CH1ctrl,chon)) {
+        gain=M.CH2gain;
+        ctrl=CH2ctrl;
+    }
+    Marker.db=(((int32_t)b*15413)>>16)-640-(gain*602+5)/10;    // 200*log10(2)/256
+    if(testbit(ctrl,chx10)) Marker.db+=200;
+}
+
+// Keep the marker as the reference, or stop showing the difference
+void MarkerDelta(void) {
+    if(testbit(MarkerCtrl,mkdelta)) clrbit(MarkerCtrl,mkdelta);
+    else {
+        MarkerRef=Marker;
+        setbit(MarkerCtrl,mkdelta);
+    }
+}
+
+// Show the marker over the trace and its readout
+void MarkerDraw(void) {
+    uint8_t y=MarkerY;
+    char const *unitF=STR_KHZ;
+    if(Srate>=7) unitF=STR_KHZ+1;   // Hz
+    if(y<6) y=6;
+    for(uint8_t i=0; i<3; i++) {        // Triangle pointing at the peak
+        for(int8_t d=-i; d<=i; d++) {
+            int16_t x=MarkerX+d;
+            if(x>=0 && x<=127) set_pixel(x, y-3-i);
+        }
+    }
+    tiny_printp(0,TEXT_LAST_LINE-2,PSTR("M"));
+    printF(4,TEXT_LAST_LINE-2,Marker.f);
+    print3x6(unitF);
+    printF(48,TEXT_LAST_LINE-2,(int32_t)Marker.db*10000);
+    print3x6(PSTR("DBV"));
+    if(testbit(MarkerCtrl,mkdelta)) {
+        tiny_printp(0,TEXT_LAST_LINE-1,PSTR("D"));
+        printF(4,TEXT_LAST_LINE-1,Marker.f-MarkerRef.f);
+        print3x6(unitF);
+        printF(48,TEXT_LAST_LINE-1,(int32_t)(Marker.db-MarkerRef.db)*10000);
+        print3x6(PSTR("DB"));
+    }
+}
+
+// Power at frequency f (Hz) in the 256 samples, sampled at fs (Hz*100).
+// Returns log2 of the power * 256, an amplitude of 1 sample is TONE_1LSB.
+// Returns 0 below 2 cycles in the samples and above Nyquist.
+static uint16_t Goertzel(const uint8_t *data, int8_t mean, uint16_t f, uint32_t fs) {
+    uint32_t a=(((uint32_t)f*102400)/(fs>>1)+1)>>1;    // 1024 steps per cycle
+    int32_t s0, s1=0, s2=0;
+    int16_t coeff;
+    uint8_t i=0, k=0;
+    if(a<8 || a>=512) return 0;
+    coeff=SinN(a+256)>>1;               // 2cos(w), Q13
+    do {
+        // s0 = x + 2cos(w)*s1 - s2, the product split in two 16x16 multiplies
+        s0=(int16_t)data[i]-128-mean;
+        s0+=((int32_t)coeff*(int16_t)(s1>>16))<<3;
+        s0+=((int32_t)coeff*(uint16_t)s1)>>13;
+        s0-=s2;
+        s2=s1; s1=s0;
+    } while(++i);
+    // |X|^2 = s1^2 + s2^2 - 2cos(w)*s1*s2, scaled down to 14 bits
+    while(s1>=8192 || s1<-8192 || s2>=8192 || s2<-8192) {
+        s1=s1>>1; s2=s2>>1; k++;
+    }
+    s0=s1*s1+s2*s2-(((int32_t)coeff*s1)>>13)*s2;
+    if(s0<=0) return 0;
+    return Log2(s0)+((uint16_t)k<<9);
+}
+
+// Power of bin k
+static uint32_t Power(uint8_t k) {
+    complex_t *b;
+    REVERSE(k);
+    b=&T.SCOPE.FFTD.bfly[k];
+    return (uint32_t)((int32_t)b->r*b->r)+(uint32_t)((int32_t)b->i*b->i);
+}
+
+// Power of the bins k-w to k+w that haven't been counted yet
+static uint32_t Lobe(uint8_t *used, uint8_t k, uint8_t w) {
+    uint32_t sum=0;
+    uint8_t j=0;
+    if(k>w) j=k-w;
+    for(; j<=k+w && j<FFT_N/2; j++) {
+        if(testbit(used[j>>3], j&7)) continue;
+        setbit(used[j>>3], j&7);
+        sum+=Power(j);
+    }
+    return sum;
+}
+
+// Power of the bins past the edge of a lobe while they keep falling, the
+// leakage of an off center tone in front of the noise
+static uint32_t Skirt(uint8_t *used, uint8_t k, int8_t step) {
+    uint32_t sum=0, last=Power(k), p;
+    for(k+=step; k>0 && k<FFT_N/2; k+=step) {
+        if(testbit(used[k>>3], k&7)) break;
+        p=Power(k);
+        if(p>=last) break;
+        setbit(used[k>>3], k&7);
+        sum+=p;
+        last=p;
+    }
+    return sum;
+}
+
+// Number of bins below Nyquist not taken by a lobe
+static uint8_t FreeBins(const uint8_t *used) {
+    uint8_t k, n=0;
+    for(k=0; k<FFT_N/2; k++) if(!testbit(used[k>>3], k&7)) n++;
+    return n;
+}
+
+// 10*log10(num/den)*10
+static int16_t dB10(uint32_t num, uint32_t den) {
+    if(num==0) num=1;
+    if(den==0) den=1;
+    return ((int32_t)(Log2(num)-Log2(den))*7707)>>16;   // 100*log10(2)/256
+}
+
+// log2(x)*256
+static int16_t Log2(uint32_t x) {
+    uint8_t n=31, i, f, a, b;
+    while(!(x&0x80000000)) { x=x<<1; n--; }
+    i=(x>>26)&31;                       // 5 bits after the leading one
+    f=x>>18;                            // Next 8 bits, to interpolate
+    a=pgm_read_byte_near(Log2Frac+i);
+    if(i==31) return (n<<8)+a+(((256-a)*f)>>8);
+    b=pgm_read_byte_near(Log2Frac+i+1);
+    return (n<<8)+a+(((b-a)*f)>>8);
+}
+
+// Zoomed spectrum of the last capture, 128 bins to T.SCOPE.FFTD.magn
+static void Zoom(void) {
+    complex_t *bfly=T.SCOPE.FFTD.bfly;
+    const int8_t *windowp=0;
+    const int8_t *raw=T.SCOPE.TempCH1;
+    uint8_t shift=ZoomShift(), D=1<<shift, d=0, pad=0, i;
+    uint16_t n, count, m=0, c=FFTCircular, phase=0, step;
+    uint32_t i1r=0, i2r=0, c1r=0, p2r=0, i1i=0, i2i=0, c1i=0, p2i=0;   // CIC, wraps around
+    windowp=FFTWindowTable();
+    Gain=pgm_read_word_near(WinCorr+WindowIndex());
+    count=FFTRawLength/D-1;             // Decimated samples, up to 256
+    // Center at M.HPos/512 of the sampling rate, the capture is x2 oversampled at Srate 1 and above
+    step=(uint16_t)M.HPos<<(Srate ? 6 : 7);
+    for(n=0; n<FFTRawLength; n++) {
+        int16_t x=raw[c];
+        if(++c>=FFTRawLength) c=0;
+        // Mix with e^-j(phase), the result is x*128 at most
+        i1r+=(int32_t)x*SinN((phase>>6)+256)>>8;
+        i1i-=(int32_t)x*SinN(phase>>6)>>8;
+        i2r+=i1r; i2i+=i1i;
+        phase+=step;
+        if(++d<D) continue;
+        d=0;
+        uint32_t yr=i2r-p2r, yi=i2i-p2i;   // Combs
+        p2r=i2r; p2i=i2i;
+        int32_t zr=yr-c1r, zi=yi-c1i;
+        c1r=yr; c1i=yi;
+        if(n<D) continue;               // The filter is still filling up
+        uint8_t j=((uint16_t)m<<8)/count;
+        int8_t w=127;
+        if(windowp) w=pgm_read_byte_near(windowp+(j<128 ? j : 255-j));
+        // CIC gain is D^2, x2 for the tone energy split between +f and -f
+        zr=zr>>(2*shift); zi=zi>>(2*shift);
+        bfly[m].r=(zr*w)>>6;
+        bfly[m].i=(zi*w)>>6;
+        m++;
+    }
+    for(; m<FFT_N; m++) bfly[m].r=bfly[m].i=0;     // Zero padding
+    fft_execute(bfly);
+    if(shift>3) pad=shift-3;            // Same tone level with zero padding
+    FFTFirst=((uint16_t)M.HPos<<(FFTZoom-1))-FFT_N/4;  // Bins from 0 Hz, negative below 0 Hz
+    for(i=0; i<FFT_N/2; i++) {
+        uint8_t k=i-FFT_N/4;            // Negative frequencies are at the top
+        REVERSE(k);
+        T.SCOPE.FFTD.magn[i]=Magnitude((int32_t)bfly[k].r<<pad, (int32_t)bfly[k].i<<pad);
+    }
+}
+
+// Index to the window tables: none, Hamming, Hann, Blackman, flat top, Kaiser
+static uint8_t WindowIndex(void) {
+    if(FFTWindow) return FFTWindow+3;
+    if(testbit(MFFT, hamming)) return 1;
+    if(testbit(MFFT, hann)) return 2;
+    if(testbit(MFFT, blackman)) return 3;
+    return 0;
+}
+
+// log2 of the decimation, from the capture rate
+static uint8_t ZoomShift(void) {
+    if(Srate) return FFTZoom+1;         // x2 oversampled
+    return FFTZoom;
+}
+
+// Sine, 1024 steps per cycle
+static int16_t SinN(uint16_t a) {
+    uint16_t r=a&0xFF;
+    int16_t s;
+    if(a&0x100) r=256-r;
+    s=pgm_read_word_near(SinQ15+r);
+    if(a&0x200) s=-s;
+    return s;
+}
+
+// Bin k of the FFT of z, the 256 point FFT output is in bit reversed order
+static void Bin(complex_t *z, uint16_t k) {
+    complex_t e, o;
+    int16_t s, c;
+    uint8_t j=k;
+    REVERSE(j);
+    e=T.SCOPE.FFTD.bfly[j];
+    if(FFTSize==FFT_512) {
+        *z=e;
+        return;
+    }
+    o=T.SCOPE.FFTD.bfly[FFT_N+j];
+    s=SinN(k<<1); c=SinN((k<<1)+256);
+    z->r=((int32_t)e.r+(((int32_t)o.r*c+(int32_t)o.i*s)>>15))>>1;
+    z->i=((int32_t)e.i+(((int32_t)o.i*c-(int32_t)o.r*s)>>15))>>1;
+}
+
+// Same conversion as fft_output
+static uint8_t Magnitude(int32_t r, int32_t i) {
+    r=(r*Gain)>>8;                      // Window correction
+    i=(i*Gain)>>8;
+    if(r>32767) r=32767;
+    if(r<-32767) r=-32767;
+    if(i>32767) i=32767;
+    if(i<-32767) i=-32767;
+    return MagnScale(Sqrt(2*((uint32_t)(r*r)+(uint32_t)(i*i))));
+}
+
+// Amplitude to magn, linear or 16*log2(b-64)
+static uint8_t MagnScale(uint16_t b) {
+    uint8_t l;
+    if(!testbit(MFFT,uselog)) {
+        if(b>=16384) return 255;
+        return b>>6;
+    }
+    if(b<=64) return 0;
+    b-=64;
+    l=240;
+    while(!(b&0x8000)) {                // Each shift is -16
+        b=b<<1;
+        l-=16;
+    }
+    return l+pgm_read_byte_near(Log2Table+((b>>11)&15));
+}
+
+// magn to the amplitude in the middle of its step
+static uint16_t MagnAmplitude(uint8_t v) {
+    if(!testbit(MFFT,uselog)) return ((uint16_t)v<<6)+32;
+    if(v==0) return 32;
+    return 64+(((uint32_t)pgm_read_word_near(Exp2Table+(v&15))<<(v>>4))>>15);
+}
+
+static uint16_t Sqrt(uint32_t v) {
+    uint32_t root=0, bit=1UL<<30;
+    while(bit) {
+        if(v>=root+bit) {
+            v-=root+bit;
+            root=(root>>1)+bit;
+        }
+        else root=root>>1;
+        bit=bit>>2;
+    }
+    return root;
+}
+
+// Bin number of a display column
+static int16_t MarkerBin(uint8_t first, uint8_t x) {
+    if(testbit(MFFT,iqfft)) return (int8_t)(first+x);  // Negative frequencies on the left
+    if(FFTDeepOn()) return x+FFTFirst;
+    return x;
+}
+
+// log2 of the magnitude before the conversion to magn, *256
+static int16_t MarkerLevel(const uint8_t *magn, uint8_t first, uint8_t x) {
+    uint8_t v=magn[(uint8_t)(first+x)];
+    if(testbit(MFFT,uselog)) {          // 16*log2(b-64)
+        if(v<96) return 6<<8;
+        return (int16_t)v<<4;
+    }
+    return Log2(((uint32_t)v<<6)+32);   // b>>6, the middle of the step
+}
+
+// The newest line goes to the right edge, the others move left: every line
+// address steps by one, and every menu byte moves back one line to stay in
+// place. One pass, the bytes of the spectra are not touched.
+static void WaterScroll(void) {
+    uint8_t *p=WaterBuf+1;                      // Address of the first line
+    uint8_t *m=WaterBuf+2+TEXT_LAST_LINE;       // Menu byte of the first line
+    uint8_t y=-WaterLine, first=*m, r;
+    for(uint8_t i=0; i<127; i++) {
+        r=(y++&127)+1;
+        REVERSE(r);
+        *p=r;
+        *m=m[DISPLAY_BYTES_IN_ROW];
+        p+=DISPLAY_BYTES_IN_ROW;
+        m+=DISPLAY_BYTES_IN_ROW;
+    }
+    r=(y&127)+1;
+    REVERSE(r);
+    *p=r;
+    *m=first;
+}
+
+// Rotate the menu line bytes of the waterfall buffer k lines towards line 0
+static void RowRotate(uint8_t k) {
+    if(k==0) return;
+    RowReverse(0, k-1);
+    RowReverse(k, 127);
+    RowReverse(0, 127);
+}
+
+// Reverse the order of the menu line bytes, from line a to line b
+static void RowReverse(uint8_t a, uint8_t b) {
+    uint8_t *x=WaterBuf+2+TEXT_LAST_LINE+(uint16_t)a*DISPLAY_BYTES_IN_ROW;
+    uint8_t *y=WaterBuf+2+TEXT_LAST_LINE+(uint16_t)b*DISPLAY_BYTES_IN_ROW;
+    while(x<y) {
+        uint8_t t=*x;
+        *x=*y;
+        *y=t;
+        x+=DISPLAY_BYTES_IN_ROW;
+        y-=DISPLAY_BYTES_IN_ROW;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+#include <stdint.h>
+
+// FFTSize values
+#define FFT_256     0       // Both channels, 256 points
+#define FFT_512     1       // One channel, 512 points
+#define FFT_1024    2       // One channel, 1024 points
+#define FFT_ZOOM    4       // Maximum FFTZoom, x16
+#define WATER_BINS  120     // Bins in the waterfall, the last text line is the menu
+
+// FFTWindow values
+#define WIN_MFFT    0       // Hamming, Hann, Blackman or none, from the MFFT bits
+#define WIN_FLATTOP 1       // Flat top, for amplitude measurements
+#define WIN_KAISER  2       // Kaiser, beta = 8, for dynamic range
+
+// FFTCtrl bits
+#define fftavgn     0x07    // Mask: log2 of the number of frames averaged, 1 to 6
+#define fftwater    3       // Waterfall display
+#define fftdist     4       // Distortion analysis
+#define fftexp      5       // Exponential average, otherwise linear
+#define fftavg      6       // Average the spectrum
+#define fftmax      7       // Max hold
+
+extern uint8_t  FFTSize;            // Number of points
+extern uint8_t  FFTWindow;          // Flat top or Kaiser, otherwise the MFFT window bits apply
+extern uint8_t  FFTZoom;            // Zoom around the center frequency, log2 of the zoom, 0 is off
+extern uint16_t FFTFirst;           // First bin on the display
+extern uint16_t FFTRawLength;       // Size of the capture buffer used by the last capture
+extern uint16_t FFTCircular;        // Oldest sample in the capture buffer
+extern uint8_t  FFTCtrl;            // Averaging, max hold and distortion options
+extern uint8_t  FFTFrames;          // Frames accumulated
+
+typedef struct {
+    int16_t thd;                // Total harmonic distortion, dB*10
+    int16_t snr;                // Signal to noise ratio, dB*10
+    int16_t sinad;              // Signal to noise and distortion ratio, dB*10
+    int16_t enob;               // Effective number of bits * 10
+    uint8_t bin;                // Fundamental bin, 0 if no signal
+} DISTORTION;
+
+extern DISTORTION Dist;             // Last distortion analysis
+
+// ToneCtrl values
+#define TONE_OFF    0
+#define TONE_DTMF   1       // The 8 DTMF tones, digits decoded
+#define TONE_50HZ   2       // 50Hz and harmonics
+#define TONE_60HZ   3       // 60Hz and harmonics
+#define TONES       8       // Frequencies watched
+#define TONE_1LSB   (14*256)        // Level of a tone of 1 sample of amplitude
+#define TONE_MIN    (TONE_1LSB+4*256)   // DTMF: 4 samples of amplitude
+#define TONE_MARGIN 512             // DTMF: 6dB over the other tones of the group
+#define TONE_TWIST  681             // DTMF: 8dB between the row and column tones
+
+extern uint8_t  ToneCtrl;           // Tone detector frequency set
+extern uint16_t ToneLevel[TONES];   // log2 of the power * 256, 0 if not measured
+
+// MarkerCtrl bits
+#define mkon        0       // Marker on
+#define mkdelta     1       // Show the difference to the reference
+#define mkpeak      2       // Move to the highest peak on the next spectrum
+#define mknext      3       // Move to the next lower peak on the next spectrum
+
+extern uint8_t  MarkerCtrl;         // Marker options and pending searches
+
+const int8_t *FFTWindowTable(void); // First half of the window, 0 if no window
+void     FFTWindowCorrect(complex_t *bfly);     // Coherent gain correction of the 256 point FFT
+uint8_t  FFTDeepOn(void);           // The 512, 1024 point or zoom FFT applies to the current settings
+uint16_t FFTCaptureLength(void);    // Samples per channel to capture
+void     FFTDeep(void);             // 512, 1024 point or zoomed spectrum of one channel
+uint8_t  FFTAccumulate(uint8_t *magn, uint16_t *acc, uint16_t n);  // Average or max hold
+void     FFTAccReset(void);         // Start accumulating again
+void     Distortion(const uint8_t *data);   // THD, SNR, SINAD and ENOB of 256 samples
+void     DistDraw(void);            // Show the distortion analysis
+void     ToneTest(void);            // Goertzel detectors on a new CH1 acquisition
+void     ToneDraw(void);            // Show the tone levels and the decoded digits
+void     ToneReset(void);           // Clear the decoded digits
+uint8_t  WaterfallActive(void);     // The waterfall owns the display buffer
+void     WaterfallCheck(void);      // Start or stop the waterfall as the settings change
+void     WaterfallStop(void);       // Give the display buffer back
+void     WaterfallLine(const uint8_t *magn, uint8_t first, uint8_t shift);  // Add a spectrum
+void     WaterfallOverlay(void);    // Move the menu just drawn to the rotated lines
+void     MarkerUpdate(const uint8_t *magn, uint8_t first, uint8_t shift, uint8_t base);   // Follow the peak
+void     MarkerDelta(void);         // Toggle the delta readout, the reference is the current marker
+void     MarkerDraw(void);          // Show the marker and its frequency and level
+
+#endif
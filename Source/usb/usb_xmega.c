@@ -12,6 +12,7 @@
 #include "usb_xmega.h"
 #include "..\mso.h"
 #include "..\interface.h"
+#include "..\awg.h"
 
 // Volatile?
 uint8_t ep0_buf_in[USB_EP0SIZE];
@@ -123,9 +124,7 @@ void USB_ResetInterface(void) {
 	endpoints[1].in.DATAPTR = (uint16_t)T.SCOPE.DC.CH1data;
 	endpoints[1].out.STATUS = 0; // Accept new data
 	endpoints[1].out.CTRL = USB_EP_TYPE_BULK_gc | USB_EP_MULTIPKT_bm | USB_EP_size_to_gc(64);
-	endpoints[1].out.DATAPTR = (uint16_t)AWGBuffer;
-	endpoints[1].out.CNT = 0;
-	endpoints[1].out.AUXDATA = 256;
+	AWGReceiveArm();
 
 	USB.CTRLA		= USB_ENABLE_bm | USB_SPEED_bm | USB_MAXEP; // Enable USB at Full Speed, USB_MAXEP endpoints
 	USB.INTCTRLA	= USB_BUSEVIE_bm | USB_INTLVL1_bm;			// Enable interrupt for Suspend, Resume or Reset Bus events
@@ -180,9 +179,8 @@ ISR(USB_TRNCOMPL_vect) {
 	} else if(endpoints[0].out.STATUS & USB_EP_TRNCOMPL0_bm) {	// OUT transaction complete on endpoint 0
 		endpoints[0].out.STATUS &= ~(USB_EP_TRNCOMPL0_bm | USB_EP_BUSNACK0_bm);
 	} else if(endpoints[1].out.STATUS & USB_EP_TRNCOMPL0_bm) {  // OUT transaction complete on endpoint 1
-    	endpoints[1].out.CNT = 0;
-	    endpoints[1].out.AUXDATA = 256;
-		endpoints[1].out.STATUS &= ~(USB_EP_BUSNACK0_bm | USB_EP_BUSNACK1_bm | USB_EP_TRNCOMPL0_bm | USB_EP_TRNCOMPL1_bm);
+		if(AWGReceive()) endpoints[1].out.STATUS &= ~(USB_EP_BUSNACK0_bm | USB_EP_BUSNACK1_bm | USB_EP_TRNCOMPL0_bm | USB_EP_TRNCOMPL1_bm);
+		else endpoints[1].out.STATUS &= ~(USB_EP_TRNCOMPL0_bm | USB_EP_TRNCOMPL1_bm);    // NAK until a slot is free
 	}
 	USB.FIFORP=0;   // Workaround to clear TRINF flag
 	USB.INTFLAGSBCLR=USB_SETUPIF_bm|USB_TRNIF_bm;
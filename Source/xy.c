@@ -0,0 +1,183 @@
+// XY mode
+// Persistence: the points of each frame are added to a hit plane, one bit per
+// pixel, in the parts of the capture buffers that the XY mode doesn't use. On
+// every new frame each pixel of the plane is cleared with a probability of
+// 1/2^n, so a point that is not hit again fades out after 2^n frames on
+// average. The plane has the layout of the display buffer, without the LCD
+// line setup bytes, and is merged into the display buffer after each frame.
+// There is no room for the plane when the FFT is also shown.
+//
+// Phase: the ellipse of two sines of the same frequency crosses the center of
+// X at Y = +-A*sin(phase), A being the amplitude of Y. The crossings are
+// interpolated between samples and averaged. The sign of the correlation of
+// X and Y gives the quadrant, the direction in which the ellipse is drawn
+// gives the sign: CH2 leading CH1 is positive.
+//
+// Z blanking: the points where the selected logic bit is low are not drawn.
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "main.h"
+#include "mso.h"
+#include "bode.h"
+#include "xy.h"
+
+#define PLANE_LINES1    96      // Display lines in the first part of the plane
+
+uint8_t XYCtrl;                     // Persistence, phase and Z blanking options
+int16_t XYPhase;                    // CH2-CH1 phase, degrees*10
+static uint8_t  XYValid;            // The plane holds persistence data
+static uint8_t  XYFrame;            // Last frame added to the plane
+static uint16_t Seed=1;             // Random numbers for the decay
+
+static uint8_t PersistOn(void);
+static uint8_t *PlaneLine(uint8_t l);
+static void Decay(void);
+static void Merge(void);
+static uint8_t Phase(uint16_t n);
+static uint16_t Sqrt(uint32_t v);
+
+// Plot the first n points, CH1 is X and CH2 is Y
+void XYDraw(uint16_t n) {
+    const uint8_t *p1=T.SCOPE.DC.CH1data, *p2=T.SCOPE.DC.CH2data, *pd=T.SCOPE.DC.CHDdata;
+    uint8_t persist=PersistOn(), zmask=0;
+    if(testbit(XYCtrl,xyzblank) && testbit(CHDctrl,digchon)) zmask=1<<((XYCtrl&xyzbit)>>4);
+    if(persist) {
+        if(!XYValid) {
+            uint8_t l=0;
+            do {
+                uint8_t *p=PlaneLine(l);
+                for(uint8_t j=16; j; j--) *p++=0;
+            } while(++l<128);
+            XYValid=1;
+            XYFrame=T.SCOPE.DC.frame;
+        }
+        if(T.SCOPE.DC.frame!=XYFrame) Decay();  // Only once per frame
+        XYFrame=T.SCOPE.DC.frame;
+    }
+    for(uint16_t i=0; i<n; i++) {
+        uint8_t x=(255-p1[i])>>1;       // Scale to 128
+        uint8_t y=p2[i]>>1;
+        if(zmask && !(pd[i]&zmask)) continue;   // Blanked
+        if(persist) PlaneLine(127-x)[y>>3] |= 0x80>>(y&7);
+        else set_pixel(x, y);
+    }
+    if(persist) Merge();
+    if(testbit(XYCtrl,xyphase)) {
+        tiny_printp(0,1,PSTR("PHASE"));
+        if(Phase(n)) printF(20,1,(int32_t)XYPhase*10000);
+        else tiny_printp(24,1,PSTR("---"));
+    }
+    if(zmask) {
+        tiny_printp(0,2,PSTR("Z BIT"));
+        putchar3x6('0'+((XYCtrl&xyzbit)>>4));
+    }
+}
+
+// Clear the plane before the next frame
+void XYClear(void) {
+    XYValid=0;
+}
+
+static uint8_t PersistOn(void) {
+    return (XYCtrl&xypersist) && !testbit(MFFT,fftmode);
+}
+
+// Lines 0 to 95 after the CH1 capture, 96 to 127 at the end of TempCHD
+static uint8_t *PlaneLine(uint8_t l) {
+    if(l<PLANE_LINES1) return T.SCOPE.XY.hits1+(uint16_t)l*16;
+    return T.SCOPE.XY.hits2+(uint16_t)(l-PLANE_LINES1)*16;
+}
+
+// Each pixel survives if any of n random bits is set
+static void Decay(void) {
+    uint8_t n=XYCtrl&xypersist, l=0;
+    uint16_t r=Seed;
+    do {
+        uint8_t *p=PlaneLine(l);
+        for(uint8_t j=16; j; j--) {
+            uint8_t keep=0;
+            for(uint8_t k=n; k; k--) {  // xorshift
+                r^=r<<7;
+                r^=r>>9;
+                r^=r<<8;
+                keep|=lobyte(r);
+            }
+            *p++&=keep;
+        }
+    } while(++l<128);
+    Seed=r;
+}
+
+// Add the plane to the display buffer
+static void Merge(void) {
+    uint8_t *d=Disp_send.SPI_Address+2, l=0;
+    do {
+        const uint8_t *p=PlaneLine(l);
+        for(uint8_t j=16; j; j--) {
+            #ifdef INVERT_DISPLAY
+            *d++ &= ~(*p++);
+            #else
+            *d++ |= *p++;
+            #endif
+        }
+        d+=2;   // Skip line LCD setup
+    } while(++l<128);
+}
+
+// Phase from the ellipse, returns 0 if there is no ellipse
+// Positions are relative to the mean, in 1/4 of a sample
+static uint8_t Phase(uint16_t n) {
+    const uint8_t *p1=T.SCOPE.DC.CH1data, *p2=T.SCOPE.DC.CH2data;
+    uint16_t sx=0, sy=0, i, crossings=0;
+    uint32_t sum=0;
+    int32_t sxy=0, area=0;
+    int16_t mx, my, x0, y0, a, b, c;
+    uint8_t max=0, min=255;
+    if(n<16) return 0;
+    for(i=0; i<n; i++) {
+        sx+=p1[i];
+        sy+=p2[i];
+        if(p2[i]>max) max=p2[i];
+        if(p2[i]<min) min=p2[i];
+    }
+    mx=((uint32_t)sx<<2)/n;
+    my=((uint32_t)sy<<2)/n;
+    a=(int16_t)(max-min)*2;             // Amplitude of Y
+    x0=((int16_t)p1[0]<<2)-mx;
+    y0=((int16_t)p2[0]<<2)-my;
+    for(i=1; i<n; i++) {
+        int16_t x1=((int16_t)p1[i]<<2)-mx;
+        int16_t y1=((int16_t)p2[i]<<2)-my;
+        sxy+=(int32_t)x1*y1;
+        area+=(int32_t)x0*y1-(int32_t)x1*y0;
+        if((x0<0 && x1>=0) || (x0>=0 && x1<0)) {    // Crosses the center of X
+            int16_t y=y0+(int32_t)(y1-y0)*(-x0)/(x1-x0);
+            if(y<0) y=-y;
+            sum+=y;
+            crossings++;
+        }
+        x0=x1;
+        y0=y1;
+    }
+    if(crossings<2 || a<16) return 0;
+    b=sum/crossings;
+    if(b>a) b=a;
+    c=Sqrt((int32_t)a*a-(int32_t)b*b);
+    if(sxy<0) c=-c;                     // Second quadrant
+    XYPhase=((int32_t)Atan2(b,c)*225)>>12;
+    if(area>0) XYPhase=-XYPhase;        // Drawn counterclockwise, CH2 lags
+    return 1;
+}
+
+static uint16_t Sqrt(uint32_t v) {
+    uint32_t root=0, bit=1UL<<30;
+    while(bit) {
+        if(v>=root+bit) {
+            v-=root+bit;
+            root=(root>>1)+bit;
+        }
+        else root=root>>1;
+        bit=bit>>2;
+    }
+    return root;
+}
@@ -0,0 +1,18 @@
+#ifndef _XY_H
+#define _XY_H
+
+#include <stdint.h>
+
+// XYCtrl bits
+#define xypersist   0x03    // Mask: persistence, a point lasts 2^n frames on average, 0 is off
+#define xyphase     2       // Show the phase
+#define xyzblank    3       // Z blanking from a logic bit
+#define xyzbit      0x70    // Mask: logic bit used for the Z blanking
+
+extern uint8_t XYCtrl;              // Persistence, phase and Z blanking options
+extern int16_t XYPhase;             // CH2-CH1 phase, degrees*10
+
+void XYDraw(uint16_t n);            // Plot the first n points
+void XYClear(void);                 // Start the persistence again
+
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#define EEMEM
+void eeprom_read_block(void*,const void*,size_t);
+void eeprom_write_block(const void*,void*,size_t);
+uint8_t eeprom_read_byte(const uint8_t*);
+void eeprom_update_block(const void*,void*,size_t);
@@ -0,0 +1,4 @@
+#pragma once
+#define ISR(v) void v(void)
+#define cli()
+#define sei()
@@ -0,0 +1,37 @@
+// Host build: the registers the tested modules use, as plain memory
+#pragma once
+#include <stdint.h>
+
+#ifndef _BV
+#define _BV(b) (1<<(b))
+#endif
+
+typedef struct {
+    volatile uint8_t  CTRLA, CTRLB, ADDRCTRL, TRIGSRC;
+    volatile uint16_t TRFCNT;
+    volatile uint8_t  REPCNT;
+    volatile uint8_t  SRCADDR0, SRCADDR1, SRCADDR2, DESTADDR0, DESTADDR1, DESTADDR2;
+} DMA_CH_t;
+typedef struct { volatile uint8_t CTRL; DMA_CH_t CH0, CH1, CH2, CH3; } DMA_t;
+typedef struct {
+    volatile uint8_t  CTRLA, CTRLB, CTRLD, INTCTRLA, INTCTRLB, INTFLAGS, CTRLFSET;
+    volatile uint16_t CNT, PER, PERBUF, CCA, CCB;
+} TC1_t;
+typedef struct { volatile uint8_t INTCTRLA, CTRLA, CTRLE; } TC0_t;
+typedef struct { volatile uint8_t CH2MUX; } EVSYS_t;
+typedef struct { volatile uint8_t CTRL; } PMIC_t;
+typedef struct { volatile uint8_t CH1DATAH; } DAC_t;
+typedef struct { volatile uint8_t IN; } VPORT_t;
+typedef struct { volatile uint8_t DIRSET, DIRCLR, OUTSET, OUTCLR; } PORT_t;
+
+extern DMA_t DMA;
+extern TC1_t TCD1;
+extern TC0_t TCD0;
+extern EVSYS_t EVSYS;
+extern PMIC_t PMIC;
+extern DAC_t DACB;
+extern PORT_t PORTB;
+extern volatile uint8_t GPIO0,GPIO1,GPIO2,GPIO3,GPIO4,GPIO5,GPIO6,GPIO7,GPIO8,GPIO9,GPIOA,GPIOB,GPIOC,GPIOD,GPIOE,GPIOF;
+
+#define TC2_LUNFINTLVL_gm       0x03
+#define TC2_LUNFINTLVL_LO_gc    0x01
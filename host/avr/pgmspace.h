@@ -0,0 +1,6 @@
+#pragma once
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte_near(a) (*(const uint8_t*)(a))
+#define pgm_read_word_near(a) (*(const uint16_t*)(a))
+#define pgm_read_dword_near(a) (*(const uint32_t*)(a))
@@ -0,0 +1,112 @@
+// DDS engine: frequency error and block refills
+// awg.c is included to reach its static state. The frequency of the DDS
+// and of the cycles/period engine is compared to the setting, then the DMA
+// is played block by block with the interrupts of awg.c, and the samples are
+// compared to a phase accumulator running without blocks. A refill that
+// comes late, after the next block ended, is also tried: the DMA must not
+// stop, the old samples of the block play again. With AM, a block refilled
+// while Shape() rewrites AWGShape for a new wave must keep the wave playing.
+// Exits with 1 if a DDS frequency is off by more than one step of the phase
+// increment, the cycles/period engine by more than CP_LIMIT, or if a block
+// plays a wrong sample or the DMA stops.
+
+#include <stdio.h>
+#include <math.h>
+#include "awg.c"
+
+#define CP_LIMIT    1.0     // %, cycles/period engine, from the period rounding
+
+static const uint32_t Freqs[] = {   // Hz*100
+    1, 100, 1234, 5000, 100000, 123456, 390630, 500000, 625000
+};
+
+// Frequency from the phase increment, Hz*100
+static double DDSActual(uint32_t f) {
+    return DDSIncrement(f)*(62500.0*100/4294967296.0);
+}
+
+// Plays blocks, the refill of each block comes after 'late' more blocks
+static unsigned Play(uint32_t f, unsigned blocks, unsigned late, unsigned *stops) {
+    uint32_t phase=0, inc;
+    unsigned bad=0, b, pending=0;
+    M.AWGtype=1; M.AWGamp=-128; M.AWGoffset=0; M.AWGduty=128;
+    M.AWGdesiredF=f;
+    setbit(AWGCtrl, awgdds);
+    AWGDMAInit();
+    AWGFlush();
+    BuildWave();
+    inc=DDSInc;
+    *stops=0;
+    for(b=0; b<blocks; b++) {
+        const uint8_t *p=DDSBuffer[DDSHalf];
+        for(uint8_t i=0; i<DDS_BLOCK; i++) {
+            if(p[i]!=AWGBuffer[(uint8_t)(phase>>24)]) bad++;
+            phase+=inc;
+        }
+        DMA.CH3.CTRLA=0;                // End of the transaction
+        DMA_CH3_vect();
+        if(!testbit(DMA.CH3.CTRLA,7)) (*stops)++;
+        if(TCD1.INTCTRLB) pending++;
+        if(pending>late) {              // The CCB interrupt runs
+            TCD1_CCB_vect();
+            pending=0;
+        }
+    }
+    clrbit(AWGCtrl, awgdds);
+    return bad;
+}
+
+// AM refill before and after Shape() makes a square wave, the wave of
+// BuildWave isn't applied yet. Returns the samples that changed.
+static unsigned AMHold(void) {
+    uint8_t a[DDS_BLOCK], b[DDS_BLOCK];
+    unsigned bad=0;
+    M.AWGtype=1; M.AWGamp=-100; M.AWGoffset=10; M.AWGduty=128;
+    M.AWGdesiredF=100000;
+    ModCtrl=MOD_AM;
+    AWGDMAInit();
+    AWGFlush();
+    BuildWave();
+    uint32_t phase=DDSPhase, mphase=ModPhase;
+    DDSFill(a);
+    DDSPhase=phase; ModPhase=mphase;
+    M.AWGtype=2;
+    Shape();
+    DDSFill(b);
+    for(uint8_t i=0; i<DDS_BLOCK; i++) if(a[i]!=b[i]) bad++;
+    ModCtrl=0;
+    return bad;
+}
+
+int main(void) {
+    double worst=0, step=62500/4294967296.0;
+    unsigned stops, bad;
+    int fail=0;
+    printf("      F (Hz)    DDS error (Hz)  cycles/period error\n");
+    for(unsigned i=0; i<sizeof(Freqs)/sizeof(Freqs[0]); i++) {
+        uint32_t f=Freqs[i];
+        double e=(DDSActual(f)-f)/100;
+        M.AWGdesiredF=f;
+        clrbit(AWGCtrl, awgdds);
+        AWGDMAInit();
+        AWGFlush();
+        BuildWave();
+        double cp=(AWGFrequency()-(double)f)*100/f;
+        printf("%12.2f  %+15.9f  %+8.3f%%\n", f/100.0, e, cp);
+        if(fabs(e)>worst) worst=fabs(e);
+        if(fabs(cp)>CP_LIMIT) fail=1;
+    }
+    printf("Largest DDS error: %.3f uHz, fs/2^32 is %.3f uHz\n", worst*1e6, step*1e6);
+    if(worst>step) fail=1;
+    bad=Play(100000, 1000, 0, &stops);
+    printf("Refill in time: %u wrong samples in 1000 blocks, %u DMA stops\n", bad, stops);
+    if(bad || stops) fail=1;
+    Play(100000, 1000, 1, &stops);
+    printf("Refill one block late: %u DMA stops\n", stops);
+    if(stops) fail=1;
+    bad=AMHold();
+    printf("AM refill while the shape changes: %u samples changed\n", bad);
+    if(bad) fail=1;
+    if(fail) printf("FAIL\n");
+    return fail;
+}
@@ -0,0 +1,51 @@
+// Host build of the firmware modules, included before every source file
+// Replaces the AVR inline assembly of mygccdef.h with plain C
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+#define _MYGCCDEF_H
+
+#ifndef _BV
+#define _BV(b) (1<<(b))
+#endif
+
+#define setbit(port, bit) ((port) |= (uint8_t)_BV(bit))
+#define setbits(port, mask) ((port) |= (uint8_t)(mask))
+#define clrbit(port, bit) ((port) &= (uint8_t)~_BV(bit))
+#define clrbits(port, mask) ((port) &= (uint8_t)~(mask))
+#define testbit(port, bit) (uint8_t)(((uint8_t)port & (uint8_t)_BV(bit)))
+#define togglebit(port, bit) (port ^= (uint8_t)_BV(bit))
+#define	hibyte(x) (uint8_t)(x>>8)
+#define	lobyte(x) (uint8_t)(x&0x00FF)
+
+#define REVERSE(a) do                     \
+{                                         \
+  a=((a>>1)&0x55)|((a<<1)&0xaa);          \
+  a=((a>>2)&0x33)|((a<<2)&0xcc);          \
+  a=(uint8_t)((a>>4)|(a<<4));             \
+} while(0)
+
+#define FMULS8(_a,_b)   ((int8_t)(((int16_t)(int8_t)(_a)*(int8_t)(_b))>>7))
+#define FMULS8R(_a,_b)  ((int8_t)(((int16_t)(int8_t)(_a)*(int8_t)(_b)+64)>>7))
+#define FMULS(_a,_b)    ((int16_t)((int16_t)(int8_t)(_a)*(int8_t)(_b)<<1))
+
+static inline void NOP(void) { }
+static inline void WDR(void) { }
+static inline void CLT(void) { }
+static inline void SET(void) { }
+static inline void SLP(void) { }
+
+#define SWAP(x,y) do { (x)=(x)^(y); (y)=(x)^(y); (x)=(x)^(y); } while(0)
+
+typedef int16_t fixed;
+#define int2fix(a)   (((int16_t)(a))<<8)
+#define fix2int(a)   ((int8_t)((a)>>8))
+#define float2fix(a) ((int16_t)((a)*256.0))
+#define fix2float(a) ((float)(a)/256.0)
+#define multfix(a,b) ((int16_t)((((int32_t)(a))*((int32_t)(b)))>>8))
+#define divfix(a,b)  ((int16_t)((((int32_t)(a))<<8)/((int32_t)(b))))
+
+#endif
@@ -0,0 +1,117 @@
+"""AWG streaming loopback on the hardware, the client side of host/stream.c.
+
+Connect the AWG output to CH1 and set the scope so a few cycles of the test
+tone fit in a frame, then run:
+  python loopback.py --rate 100000 --srate 20000 [--tone 1000] [--seconds 10]
+
+--rate is the stream rate in Hz; the firmware limits it to 32MHz/(STREAM_MINPER+1).
+--srate is the scope sample rate of the timebase in use, in Hz.
+
+The client starts the stream with the 'S' vendor command, and a thread sends
+the tone through EP1 OUT; the device NAKs while its ring is full. The main
+thread reads the 770 byte frames from EP1 IN, fits a sine at the tone
+frequency to the 256 CH1 samples of each frame, and checks the residual.
+At the end 'S' reads the underruns counted by the device, then stops the
+stream. Exits with 1 if a frame doesn't match the tone or the ring ran out.
+Requires pyusb.
+"""
+import argparse
+import math
+import sys
+import threading
+import time
+
+import usb.core
+
+VID, PID = 0x16D0, 0x06F9
+PACKET = 64
+FRAME = 770                 # CH1, CH2 and CHD samples, frame and index
+MAX_RESIDUAL = 0.10         # Of the fitted amplitude, rms
+MIN_AMPLITUDE = 8           # Samples, below it the tone is not reaching CH1
+
+
+def stream_cmd(dev, per):
+    """'S': set the period (0 stops, 0xFFFF only reads), returns the underruns."""
+    r = dev.ctrl_transfer(0xC0, ord('S'), per, 0, 2)
+    return r[0] | r[1] << 8
+
+
+def tone(rate, f, amplitude=100):
+    """Blocks of the tone at the stream rate, the phase runs on across blocks."""
+    n = 0
+    while True:
+        block = bytearray(PACKET * 16)
+        for i in range(len(block)):
+            block[i] = 128 + int(round(amplitude * math.sin(2 * math.pi * f * n / rate)))
+            n += 1
+        yield bytes(block)
+
+
+def fit(x, f, fs):
+    """Least squares fit of a*cos + b*sin + c at f, returns the amplitude and
+    the rms residual."""
+    w = 2 * math.pi * f / fs
+    rows = [(math.cos(w * n), math.sin(w * n), 1.0) for n in range(len(x))]
+    m = [[sum(r[i] * r[j] for r in rows) for j in range(3)] for i in range(3)]
+    v = [sum(r[i] * s for r, s in zip(rows, x)) for i in range(3)]
+    for i in range(3):                      # Gauss-Jordan, the matrix is well conditioned
+        p = m[i][i]
+        m[i] = [e / p for e in m[i]]
+        v[i] /= p
+        for k in range(3):
+            if k != i:
+                q = m[k][i]
+                m[k] = [a - q * b for a, b in zip(m[k], m[i])]
+                v[k] -= q * v[i]
+    a, b, c = v
+    res = [s - (a * r[0] + b * r[1] + c) for r, s in zip(rows, x)]
+    return math.hypot(a, b), math.sqrt(sum(e * e for e in res) / len(res))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--rate', type=int, required=True, help='stream rate, Hz')
+    ap.add_argument('--srate', type=float, required=True, help='scope sample rate, Hz')
+    ap.add_argument('--tone', type=float, default=1000)
+    ap.add_argument('--seconds', type=float, default=10)
+    args = ap.parse_args()
+
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        sys.exit('device not found')
+    dev.set_configuration()
+    per = 32000000 // args.rate - 1
+    stream_cmd(dev, per)
+
+    stop = threading.Event()
+
+    def sender():
+        for block in tone(args.rate, args.tone):
+            if stop.is_set():
+                break
+            dev.write(0x01, block, timeout=1000)
+    t = threading.Thread(target=sender, daemon=True)
+    t.start()
+
+    frames = bad = 0
+    start = time.time() + 0.5               # The ring fills, the trace settles
+    end = start + args.seconds
+    while time.time() < end:
+        data = dev.read(0x81, FRAME, timeout=2000)
+        if len(data) < 256 or time.time() < start:
+            continue
+        amp, res = fit(list(data[:256]), args.tone, args.srate)
+        frames += 1
+        if amp < MIN_AMPLITUDE or res > MAX_RESIDUAL * amp:
+            bad += 1
+            print('frame %d: amplitude %.1f, residual %.1f' % (frames, amp, res))
+    underruns = stream_cmd(dev, 0xFFFF)     # Before the sender stops
+    stop.set()
+    t.join(2)
+    stream_cmd(dev, 0)
+    print('%d frames, %d wrong, %d underruns' % (frames, bad, underruns))
+    sys.exit(1 if bad or underruns or not frames else 0)
+
+
+if __name__ == '__main__':
+    main()
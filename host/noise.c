@@ -0,0 +1,207 @@
+// Noise generators: power spectrum of the DAC samples
+// awg.c is included to reach its static state. Each generator is set up by
+// BuildWave, its blocks are taken from NoiseFill, and the spectrum is the
+// average of 4096 point periodograms with a Hann window over 2^20 samples,
+// at fs=62.5kHz. The spectral flatness is the geometric over the arithmetic
+// mean of the bins from 62.5Hz to 25kHz, 0 dB for a flat spectrum. The
+// repeated table is measured too, its lines at fs/256 make it far from flat.
+// The same generators then go through the spectrum of the scope: FFTDeep,
+// 1024 points with the Hann window, and FFTAccumulate, 64 frames averaged,
+// as if the AWG output was captured on CH1 at fs.
+// Exits with 1 if a generator is out of its limits.
+
+#include <stdio.h>
+#include <math.h>
+#include <complex.h>
+#include "awg.c"
+#include "spectrum.h"
+
+#define N       4096
+#define SEGS    256
+#define FS      62500.0
+#define FRAMES  64          // Averaged by the scope
+#define WHITE_FLAT  0.1     // dB, flatness and slope per octave of white noise
+#define PINK_SLOPE  0.3     // dB per octave, from -3.01
+#define BAND_F      0.5     // dB, level at the cutoff, from -3.01
+#define BOARD_LIMIT 1.0     // dB, the same checks on the scope spectrum
+
+static double PSD[N/2];
+
+static void FFT(double complex *x) {
+    for(unsigned i=1, j=0; i<N; i++) {
+        unsigned b=N>>1;
+        for(; j&b; b>>=1) j^=b;
+        j|=b;
+        if(i<j) { double complex t=x[i]; x[i]=x[j]; x[j]=t; }
+    }
+    for(unsigned l=2; l<=N; l<<=1) {
+        double complex w=cexp(-2*M_PI*I/l);
+        for(unsigned i=0; i<N; i+=l) {
+            double complex u=1;
+            for(unsigned k=0; k<l/2; k++) {
+                double complex t=u*x[i+k+l/2];
+                x[i+k+l/2]=x[i+k]-t;
+                x[i+k]+=t;
+                u*=w;
+            }
+        }
+    }
+}
+
+// Spectrum of the generator, type NOISE_*, band cutoff f in Hz*100
+static void Measure(uint8_t type, uint32_t f) {
+    static double complex x[N];
+    uint8_t block[DDS_BLOCK];
+    unsigned t=0;
+    M.AWGtype=0; M.AWGamp=-128; M.AWGoffset=0; M.AWGduty=128;
+    M.AWGdesiredF=f;
+    NoiseCtrl=type;
+    AWGDMAInit();
+    AWGFlush();
+    BuildWave();
+    for(unsigned k=0; k<N/2; k++) PSD[k]=0;
+    for(unsigned s=0; s<SEGS; s++) {
+        for(unsigned n=0; n<N; n+=DDS_BLOCK) {
+            if(type==NOISE_TABLE) for(uint8_t i=0; i<DDS_BLOCK; i++) block[i]=AWGBuffer[(uint8_t)t++];
+            else NoiseFill(block);
+            for(uint8_t i=0; i<DDS_BLOCK; i++)
+                x[n+i]=(block[i]-128)*(0.5-0.5*cos(2*M_PI*(n+i)/N));
+        }
+        FFT(x);
+        for(unsigned k=0; k<N/2; k++) PSD[k]+=creal(x[k]*conj(x[k]))/SEGS;
+    }
+}
+
+static unsigned Bin(double hz) { return lround(hz*N/FS); }
+
+// Mean power of the bins from lo to hi Hz, in dB
+static double Level(double lo, double hi) {
+    double p=0;
+    unsigned a=Bin(lo), b=Bin(hi);
+    for(unsigned k=a; k<b; k++) p+=PSD[k];
+    return 10*log10(p/(b-a));
+}
+
+static double Flatness(void) {
+    double g=0, a=0;
+    unsigned lo=Bin(62.5), hi=Bin(25000);
+    for(unsigned k=lo; k<hi; k++) { g+=log(PSD[k]); a+=PSD[k]; }
+    return 10*log10(exp(g/(hi-lo))/(a/(hi-lo)));
+}
+
+// Octave levels from 62.5Hz to 16kHz, relative to the first, and the slope
+// of a straight line through them in dB per octave
+static double Octaves(void) {
+    double l[8], sx=0, sy=0, sxx=0, sxy=0;
+    for(int o=0; o<8; o++) {
+        l[o]=Level(62.5*(1<<o), 125*(1<<o));
+        printf(" %6.1f", l[o]-l[0]);
+        sx+=o; sy+=l[o]; sxx+=o*o; sxy+=o*l[o];
+    }
+    return (8*sxy-sx*sy)/(8*sxx-sx*sx);
+}
+
+// Scope spectrum of the generator: 128 bins from bin 'first' of 512, averaged
+static uint8_t Magn[2][FFT_N/2];
+
+static void Board(uint8_t type, uint32_t f) {
+    uint8_t block[DDS_BLOCK];
+    M.AWGtype=0; M.AWGamp=-128; M.AWGoffset=0; M.AWGduty=128;
+    M.AWGdesiredF=f;
+    NoiseCtrl=type;
+    AWGDMAInit();
+    AWGFlush();
+    BuildWave();
+    Srate=0;                        // No oversampling
+    MFFT=_BV(fftmode)|_BV(hann)|_BV(uselog);
+    FFTWindow=WIN_MFFT;
+    FFTSize=FFT_1024;
+    FFTZoom=0;
+    FFTCtrl=_BV(fftavg)|6;          // Linear, 64 frames
+    FFTRawLength=FFTCaptureLength();
+    FFTCircular=0;
+    for(uint8_t h=0; h<2; h++) {    // Bins 0 to 127, then 256 to 383
+        M.HPos=h*128;
+        FFTAccReset();
+        for(unsigned r=0; r<FRAMES; r++) {
+            for(unsigned n=0; n<FFTRawLength; n+=DDS_BLOCK) {
+                NoiseFill(block);
+                for(uint8_t i=0; i<DDS_BLOCK; i++) T.SCOPE.TempCH1[n+i]=block[i]-128;
+            }
+            T.SCOPE.DC.frame++;
+            FFTDeep();
+            FFTAccumulate(T.SCOPE.FFTD.magn, T.SCOPE.FFTD.acc, FFT_N/2);
+        }
+        for(uint8_t i=0; i<FFT_N/2; i++) Magn[h][i]=T.SCOPE.FFTD.magn[i];
+    }
+}
+
+// Mean power of the scope bins from lo to hi-1, of 512, in dB. magn is 16*log2
+// of the amplitude, 16 steps per 6dB
+static double BoardLevel(unsigned lo, unsigned hi) {
+    double p=0;
+    for(unsigned k=lo; k<hi; k++) p+=pow(2, Magn[k>=256][k&127]/8.0);
+    return 10*log10(p/(hi-lo));
+}
+
+// Level of the scope bins of each octave from 122Hz to 7.8kHz, slope per octave
+static double BoardSlope(void) {
+    double sx=0, sy=0, sxx=0, sxy=0;
+    for(int o=0; o<6; o++) {
+        double l=BoardLevel(2<<o, 4<<o);
+        sx+=o; sy+=l; sxx+=o*o; sxy+=o*l;
+    }
+    return (6*sxy-sx*sy)/(6*sxx-sx*sx);
+}
+
+static int Check(double v, double expected, double limit) {
+    if(fabs(v-expected)<=limit) return 0;
+    printf("  FAIL");
+    return 1;
+}
+
+int main(void) {
+    static const char *name[]={ "table", "white", "pink" };
+    int fail=0;
+    double s=0, fl;
+    printf("       octaves from 62.5Hz (dB)                           slope/oct  flatness\n");
+    for(uint8_t type=NOISE_TABLE; type<=NOISE_PINK; type++) {
+        Measure(type, 100000);
+        printf("%-6s", name[type]);
+        if(type==NOISE_TABLE) printf("%*s", 66, "");    // Lines, no octave level
+        else printf("  %+6.2f dB", s=Octaves());
+        printf("  %7.2f dB", fl=Flatness());
+        if(type==NOISE_WHITE) fail|=Check(s, 0, WHITE_FLAT) || Check(fl, 0, WHITE_FLAT);
+        if(type==NOISE_PINK) fail|=Check(s, -3.01, PINK_SLOPE);
+        printf("\n");
+    }
+    static const uint32_t cut[]={ 50000, 100000, 500000 };     // Hz*100
+    printf("band    cutoff    F/2     F    2F    4F  (dB from 30-90Hz, +-20%% of each)\n");
+    for(int c=0; c<3; c++) {
+        double f=cut[c]/100.0, r, lf;
+        Measure(NOISE_BAND, cut[c]);
+        r=Level(30, 90);
+        lf=Level(f*0.8, f*1.2)-r;
+        printf("       %6.0fHz %5.1f %5.1f %5.1f %5.1f", f, Level(f/2*0.8, f/2*1.2)-r,
+            lf, Level(f*2*0.8, f*2*1.2)-r, Level(f*4*0.8, f*4*1.2)-r);
+        fail|=Check(lf, -3.01, BAND_F);
+        printf("\n");
+    }
+    // The scope: 61Hz bins, white 1.9-7.8kHz against 15.6-23.4kHz, pink
+    // octaves, band 1kHz at bins 15 to 18 against 122-366Hz
+    printf("scope spectrum, %d frames\n", FRAMES);
+    Board(NOISE_WHITE, 100000);
+    s=BoardLevel(256, 384)-BoardLevel(32, 128);
+    printf("white   high - low band %+6.2f dB", s);
+    fail|=Check(s, 0, BOARD_LIMIT);
+    Board(NOISE_PINK, 100000);
+    s=BoardSlope();
+    printf("\npink    slope %+6.2f dB/oct", s);
+    fail|=Check(s, -3.01, BOARD_LIMIT);
+    Board(NOISE_BAND, 100000);
+    s=BoardLevel(15, 19)-BoardLevel(2, 6);
+    printf("\nband    1000Hz %+6.2f dB", s);
+    fail|=Check(s, -3.01, BOARD_LIMIT);
+    printf("\n");
+    return fail;
+}
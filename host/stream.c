@@ -0,0 +1,89 @@
+// USB streaming loopback: a host sends a known sequence in 64 byte packets
+// through the EP1 OUT path of awg.c, the DMA plays the ring, and the samples
+// that reach the DAC are compared to the sequence.
+// The USB side sends up to 'burst' packets per 1ms frame while the endpoint
+// isn't NAKing, and can pause for whole frames. The DMA side takes one byte
+// per sample from the address in the channel registers and calls the
+// transaction interrupt at the end of each slot, like the hardware.
+// The host sends at frame starts, so a pause of n frames leaves n+1 ms
+// without data. Longer than the ring, it must show as underruns, never as
+// lost, repeated or reordered samples. At the fastest rate the ring must
+// ride through two missed frames.
+// Exits with 1 if a sample is wrong, or if the underruns are not the ones
+// expected. loopback.py is the same test on the hardware, through CH1.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "awg.c"
+
+// The 16 bit DMA and USB addresses, back to host pointers into AWGWave
+static uint8_t *HostPtr(uint16_t a) {
+    return (uint8_t *)AWGWave+(uint16_t)(a-(uint16_t)(uintptr_t)AWGWave);
+}
+
+static uint8_t Expected(uint32_t n) {   // Test sequence, not periodic in the ring
+    return (n*7+(n>>8)*13)&0xFF;
+}
+
+// The period is in 32MHz cycles, as the 'S' command sends it. Runs for 'ms'
+// frames, the host sends nothing for 'gap' frames every 'every' frames.
+// Returns 1 if a sample is wrong, or if there are underruns and 'under' is
+// 0, or none and it is 1.
+static int Run(uint16_t per, unsigned burst, unsigned ms, unsigned every, unsigned gap, int under) {
+    uint32_t sent=0, played=0, wrong=0, held=0, acc=0, fs;
+    uint8_t *src=0, active=0;
+    uint16_t count=0;
+    int fail;
+    AWGStream(per);
+    fs=32000000/(TCD1.PERBUF+1);        // The rate after the limit
+    for(unsigned t=0; t<ms; t++) {
+        // USB frame: packets while the endpoint takes them
+        if(!(every && t%every<gap)) for(unsigned k=0; k<burst; k++) {
+            if(endpoints[1].out.STATUS & USB_EP_BUSNACK0_bm) break;
+            uint8_t *p=HostPtr(endpoints[1].out.DATAPTR);
+            for(uint8_t i=0; i<STREAM_PACKET; i++) p[i]=Expected(sent+i);
+            sent+=STREAM_PACKET;
+            endpoints[1].out.CNT=STREAM_PACKET;
+            endpoints[1].out.STATUS |= USB_EP_BUSNACK0_bm|USB_EP_TRNCOMPL0_bm;
+            if(AWGReceive()) endpoints[1].out.STATUS &= ~(USB_EP_BUSNACK0_bm|USB_EP_BUSNACK1_bm|USB_EP_TRNCOMPL0_bm);
+            else endpoints[1].out.STATUS &= ~USB_EP_TRNCOMPL0_bm;
+        }
+        // DAC samples in this frame
+        acc+=fs;
+        for(; acc>=1000; acc-=1000) {
+            if(!active && testbit(DMA.CH3.CTRLA,7)) {
+                src=HostPtr(DMA.CH3.SRCADDR0|(uint16_t)DMA.CH3.SRCADDR1<<8);
+                count=DMA.CH3.TRFCNT;
+                active=1;
+            }
+            if(!active) {
+                if(played) held++;
+                continue;
+            }
+            if(*src++!=Expected(played)) wrong++;
+            played++;
+            if(--count==0) {
+                active=0;
+                clrbit(DMA.CH3.CTRLA,7);
+                if(DMA.CH3.CTRLB&0x03) DMA_CH3_vect();
+            }
+        }
+    }
+    fail=wrong || (StreamUnderruns!=0)!=under;
+    printf("%6lukHz %2u packets/ms  pause %2ums every %3ums:  %7lu sent  %7lu played  %lu wrong  %u underruns  %lu samples held%s\n",
+        (unsigned long)fs/1000, burst, gap, every, (unsigned long)sent, (unsigned long)played,
+        (unsigned long)wrong, StreamUnderruns, (unsigned long)held, fail ? "  FAIL" : "");
+    AWGStream(0);
+    return fail;
+}
+
+int main(void) {
+    int fail=0;
+    fail|=Run(127, 5, 2000, 0, 0, 0);           // 250kHz asked, the fastest rate plays, the host keeps up
+    fail|=Run(STREAM_MINPER, 19, 2000, 0, 0, 0);    // Full speed bulk limit
+    fail|=Run(STREAM_MINPER, 3, 2000, 100, 2, 0);   // Two missed frames: 3ms without data fit in the ring
+    fail|=Run(STREAM_MINPER, 3, 2000, 100, 3, 1);   // Three don't, underruns but no wrong sample
+    fail|=Run(319, 2, 2000, 100, 3, 0);         // 100kHz: the ring is 5.12ms, 4ms without data fit
+    fail|=Run(319, 2, 2000, 100, 5, 1);         // 6ms don't
+    return fail;
+}
@@ -0,0 +1,77 @@
+// Host build of the firmware modules
+// Globals normally defined in main.c and the display driver, the display
+// calls draw nothing, and the FFT is a plain DFT with the same output
+// scaling and bit reversed order as ffft.S
+
+#include <math.h>
+#include <string.h>
+#include <avr/io.h>
+#include "main.h"
+#include "display.h"
+#include "usb_stub.h"
+
+DMA_t DMA;
+TC1_t TCD1;
+TC0_t TCD0;
+EVSYS_t EVSYS;
+PMIC_t PMIC;
+DAC_t DACB;
+PORT_t PORTB;
+volatile uint8_t GPIO0,GPIO1,GPIO2,GPIO3,GPIO4,GPIO5,GPIO6,GPIO7,GPIO8,GPIO9,GPIOA,GPIOB,GPIOC,GPIOD,GPIOE,GPIOF;
+TempData T;
+NVMVAR M;
+Disp_data Disp_send;
+uint8_t u8CursorX, u8CursorY;
+USB_EP_pair_t endpoints[USB_MAXEP+1];
+const uint32_t freqval[22];         // Sampling rate readouts are not checked on the host
+
+// EEMEM variables are ordinary memory on the host
+void eeprom_read_block(void *dst, const void *src, size_t n) { memcpy(dst, src, n); }
+void eeprom_write_block(const void *src, void *dst, size_t n) { memcpy(dst, src, n); }
+void eeprom_update_block(const void *src, void *dst, size_t n) { memcpy(dst, src, n); }
+uint8_t eeprom_read_byte(const uint8_t *p) { return *p; }
+
+void print3x6(const char *s) { (void)s; }
+void putchar3x6(char c) { (void)c; }
+void clr_display(void) { }
+void printF(uint8_t x, uint8_t y, int32_t Data) { (void)x; (void)y; (void)Data; }
+void tiny_printp(uint8_t x, uint8_t y, const char *ptr) { (void)x; (void)y; (void)ptr; }
+void LCD_LineAddresses(uint8_t *setup, uint8_t first) { (void)setup; (void)first; }
+void WaitDisplay(void) { }
+void set_pixel(uint8_t x, uint8_t y) { (void)x; (void)y; }
+void set_line(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2) { (void)x1; (void)y1; (void)x2; (void)y2; }
+
+// 256 point FFT, output divided by N and stored in bit reversed order
+void fft_execute(complex_t *b) {
+    static complex_t o[FFT_N];
+    for(int k=0; k<FFT_N; k++) {
+        double re=0, im=0;
+        for(int n=0; n<FFT_N; n++) {
+            double a=-2*M_PI*k*n/FFT_N;
+            re+=b[n].r*cos(a)-b[n].i*sin(a);
+            im+=b[n].r*sin(a)+b[n].i*cos(a);
+        }
+        uint8_t r=k;
+        REVERSE(r);
+        o[r].r=lround(re/FFT_N);
+        o[r].i=lround(im/FFT_N);
+    }
+    for(int k=0; k<FFT_N; k++) b[k]=o[k];
+}
+
+// ffft.S: sine of angle/256 of a cycle, the high byte of the Q15 table
+int8_t Sin(uint8_t angle) {
+    return (int16_t)lround(32767*sin(2*M_PI*angle/256))>>8;
+}
+
+// asmutil.S: signed add with saturation, returned offset by 128
+uint8_t saddwsat(int8_t a, int8_t b) {
+    int16_t s=a+b;
+    if(s>127) s=127;
+    if(s<-128) s=-128;
+    return s+128;
+}
+
+uint8_t addwsat(uint8_t a, int8_t b) {
+    return saddwsat(a-128, b);
+}
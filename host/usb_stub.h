@@ -0,0 +1,18 @@
+// Host build: the USB endpoint table awg.c reads, no USB stack
+// The Makefile makes "usb\usb_xmega.h" include this file
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+    volatile uint8_t  STATUS, CTRL;
+    volatile uint16_t CNT, DATAPTR, AUXDATA;
+} USB_EP_t;
+
+typedef struct { USB_EP_t out, in; } USB_EP_pair_t;
+
+#define USB_MAXEP           1
+#define USB_EP_BUSNACK0_bm  0x02
+#define USB_EP_BUSNACK1_bm  0x04
+#define USB_EP_TRNCOMPL0_bm 0x20
+
+extern USB_EP_pair_t endpoints[USB_MAXEP+1];
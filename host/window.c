@@ -0,0 +1,99 @@
+// Window amplitude correction on the 256 point FFT
+// A tone of 100 counts is windowed the way fft_stuff() does it, with the
+// window tables from data.c, then corrected by FFTWindowCorrect(). The
+// level of the highest bin is compared to a rectangular window on a bin
+// center, for offsets of 0 to 0.5 bin from the center.
+// The scalloping of each window is also computed from its formula in data.c.
+// Exits with 1 if a level on a bin center is off by more than LIMIT0, or if
+// a level off center differs from the formula by more than LIMIT.
+
+#include <stdio.h>
+#include <math.h>
+#include <avr/io.h>
+#include "main.h"
+#include "spectrum.h"
+
+#define LIMIT0  0.05    // dB, on a bin center, the window correction
+#define LIMIT   0.10    // dB, from the scalloping of the exact window
+
+static complex_t bfly[FFT_N];
+
+static double I0(double x) {
+    double s=1, t=1;
+    for(int k=1; k<30; k++) { t*=x*x/4/k/k; s+=t; }
+    return s;
+}
+
+// The windows of data.c, before rounding to 8 bits
+static double Exact(int w, int n) {
+    double c=2*M_PI*n/(FFT_N-1), x=2.0*n/(FFT_N-1)-1;
+    switch(w) {
+        case 1: return 0.54-0.46*cos(c);
+        case 2: return 0.5-0.5*cos(c);
+        case 3: return 0.42-0.5*cos(c)+0.08*cos(2*c);
+        case 4: return 0.21557895-0.41663158*cos(c)+0.277263158*cos(2*c)-0.083578947*cos(3*c)+0.006947368*cos(4*c);
+        case 5: return I0(8*sqrt(1-x*x))/I0(8);
+    }
+    return 1;
+}
+
+// Highest bin of the exact window for a tone off by o bin, relative to the
+// tone on a bin center, in dB
+static double Scallop(int w, double o) {
+    double re=0, im=0, sum=0;
+    for(int n=0; n<FFT_N; n++) {
+        double e=Exact(w, n);
+        re+=e*cos(M_PI*o*n*2/FFT_N);
+        im+=e*sin(M_PI*o*n*2/FFT_N);
+        sum+=e;
+    }
+    return 20*log10(hypot(re, im)/sum);
+}
+
+// Highest bin of a windowed tone at the given bin, in dB
+static double Level(double bin) {
+    const int8_t *windowp=FFTWindowTable();
+    double peak=0;
+    uint8_t i=0;
+    do {
+        int8_t w=127, s=lround(100*cos(2*M_PI*bin*i/FFT_N));
+        if(windowp) w=pgm_read_byte_near(windowp+(i<128 ? i : 255-i));
+        bfly[i].r=FMULS(s, w);
+        bfly[i].i=0;
+    } while(++i);
+    fft_execute(bfly);
+    FFTWindowCorrect(bfly);
+    do {
+        double m=hypot(bfly[i].r, bfly[i].i);
+        if(m>peak) peak=m;
+    } while(++i);
+    return 20*log10(peak);
+}
+
+int main(void) {
+    static const char *name[]={ "rect", "hamming", "hann", "blackman", "flattop", "kaiser" };
+    double ref;
+    int fail=0;
+    MFFT=_BV(fftmode)|_BV(iqfft);
+    FFTWindow=0;
+    ref=Level(32);
+    for(int w=0; w<6; w++) {
+        double lo=1e9, hi=-1e9;
+        int bad=0;
+        MFFT=_BV(fftmode)|_BV(iqfft);
+        FFTWindow=0;
+        if(w>=1 && w<=3) setbit(MFFT, w-1);
+        if(w>=4) FFTWindow=w-3;
+        printf("%-8s", name[w]);
+        for(int o=0; o<=10; o++) {
+            double l=Level(32+o*0.05)-ref;
+            if(l<lo) lo=l;
+            if(l>hi) hi=l;
+            if(!(o&1)) printf(" %6.2f", l);
+            if(fabs(l-Scallop(w, o*0.05))>(o ? LIMIT : LIMIT0)) bad=1;
+        }
+        printf("  dB at 0..0.5 bin, spread %.2f dB (%.2f)%s\n", hi-lo, -Scallop(w, 0.5), bad ? "  FAIL" : "");
+        fail|=bad;
+    }
+    return fail;
+}